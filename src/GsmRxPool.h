@@ -0,0 +1,186 @@
+/*
+ * Copyright (C) 2018 Orange
+ *
+ * This software is distributed under the terms and conditions of the GNU Lesser
+ * General Public License (LGPL-3.0) which can be found in the file 'LICENSE.txt'
+ * in this package distribution.
+ */
+
+#ifndef __GsmRxPool_h
+#define __GsmRxPool_h
+
+/*
+ * Arena of N fixed-size blocks of S bytes, shared by the receive fifos of several sockets.
+ */
+template <unsigned S, unsigned N>
+class GsmRxPool
+{
+public:
+    enum { BLOCK_SIZE = S, BLOCKS = N, NONE = 0xFF };
+    static_assert(N < NONE, "GsmRxPool: blocks are indexed by uint8_t, 0xFF meaning none");
+
+    GsmRxPool()
+    {
+        for (unsigned i = 0; i < N; i++)
+            _next[i] = (i + 1 < N) ? i + 1 : (unsigned) NONE;
+        _free = 0;
+        _available = N;
+    }
+
+    // Borrow a block. Returns NONE if all blocks are in use.
+    uint8_t alloc(void)
+    {
+        uint8_t i = _free;
+        if (i == NONE)
+            return NONE;
+        _free = _next[i];
+        _available--;
+        return i;
+    }
+
+    void release(uint8_t i)
+    {
+        _next[i] = _free;
+        _free = i;
+        _available++;
+    }
+
+    uint8_t* block(uint8_t i)
+    {
+        return _b[i];
+    }
+
+    unsigned available(void)
+    {
+        return _available;
+    }
+
+private:
+    uint8_t  _b[N][S];
+    uint8_t  _next[N];
+    uint8_t  _free;
+    unsigned _available;
+};
+
+/*
+ * Receive fifo made of blocks borrowed from a GsmRxPool on demand, and returned once read,
+ * holding at most M blocks and at most its limit (see setLimit()).
+ * Same interface as GsmFifo.
+ */
+template <class P, unsigned M>
+class GsmPooledFifo
+{
+public:
+    GsmPooledFifo()
+    {
+        _pool = NULL;
+        _limit = M;
+        _count = 0;
+        _r = 0;
+        _w = 0;
+    }
+
+    void init(P* pool)
+    {
+        _pool = pool;
+    }
+
+    // Maximum number of blocks borrowed by this fifo, so that a busy socket can't starve the others
+    void setLimit(uint8_t limit)
+    {
+        _limit = (limit < M) ? limit : M;
+        if (_limit == 0)
+            _limit = 1;
+    }
+
+    void clear()
+    {
+        for (uint8_t i = 0; i < _count; i++)
+            _pool->release(_blocks[i]);
+        _count = 0;
+        _r = 0;
+        _w = 0;
+    }
+
+    // writing thread/context API
+    //-------------------------------------------------------------
+
+    bool writeable(void)
+    {
+        return free() > 0;
+    }
+
+    int free(void)
+    {
+        int f = _count ? P::BLOCK_SIZE - _w : 0;
+        unsigned more = _limit - _count;
+        if (more > _pool->available())
+            more = _pool->available();
+        return f + more * P::BLOCK_SIZE;
+    }
+
+    bool put(const uint8_t& c)
+    {
+        if (!_count || _w == P::BLOCK_SIZE) {
+            if (_count >= _limit)
+                return false;
+            uint8_t b = _pool->alloc();
+            if (b == P::NONE)
+                return false;
+            _blocks[_count++] = b;
+            _w = 0;
+        }
+        _pool->block(_blocks[_count - 1])[_w++] = c;
+        return true;
+    }
+
+    // reading thread/context API
+    // --------------------------------------------------------
+
+    bool readable(void)
+    {
+        return size() > 0;
+    }
+
+    size_t size(void)
+    {
+        if (!_count)
+            return 0;
+        return (size_t) (_count - 1) * P::BLOCK_SIZE + _w - _r;
+    }
+
+    int get(uint8_t* p, int n)
+    {
+        int c = n;
+        while (c && _count)
+        {
+            // available data in the first block
+            int f = ((_count == 1) ? _w : (int) P::BLOCK_SIZE) - _r;
+            if (c < f) f = c;
+            memcpy(p, _pool->block(_blocks[0]) + _r, f);
+            _r += f;
+            c -= f;
+            p += f;
+            if (_r == ((_count == 1) ? _w : (int) P::BLOCK_SIZE)) {
+                // first block drained: return it to the pool
+                _pool->release(_blocks[0]);
+                _count--;
+                memmove(_blocks, _blocks + 1, _count);
+                _r = 0;
+                if (!_count)
+                    _w = 0;
+            }
+        }
+        return n - c;
+    }
+
+private:
+    P*       _pool;
+    uint8_t  _blocks[M];
+    uint8_t  _limit;
+    uint8_t  _count;
+    uint16_t _r;    // read offset in the first block
+    uint16_t _w;    // write offset in the last block
+};
+
+#endif
@@ -0,0 +1,114 @@
+/*
+ * Copyright (C) 2018 Orange
+ *
+ * This software is distributed under the terms and conditions of the GNU Lesser
+ * General Public License (LGPL-3.0) which can be found in the file 'LICENSE.txt'
+ * in this package distribution.
+ */
+
+#ifndef __GsmScheduler_h
+#define __GsmScheduler_h
+
+#include <HeraclesGsmModem.h>
+
+struct GsmSchedulerStats {
+    uint32_t steps;         // Modem steps run
+    uint32_t busySteps;     // Steps which sent commands to their modem
+    uint32_t maxStepTime;   // Longest step (us): worst latency added to the other modems
+    uint32_t totalStepTime; // Sum of step durations (us)
+    uint32_t commands;      // AT command lines sent by all modems (0 without GSM_ENABLE_STATS)
+    uint32_t bytesSent;     // Socket data bytes accepted by all modems (0 without GSM_ENABLE_STATS)
+    uint32_t bytesReceived; // Socket data bytes received from all modems (0 without GSM_ENABLE_STATS)
+};
+
+/*
+ * Cooperative scheduler driving up to N modems (each one on its own serial port)
+ * from a single event loop: modems are stepped in round robin with HeraclesGsmModem::poll(),
+ * so that no thread per modem is needed.
+ * Each step blocks the other modems for its AT round trip (see HeraclesGsmModem::poll() for the bounds):
+ * the worst latency added to the other modems is reported by stats().maxStepTime.
+ * All modem functions (connect, read, write, ...) must be called from the same loop.
+ * Modem is HeraclesGsmModem, or BasicHeraclesGsmModem<SerialT> for modems on a concrete serial type.
+ */
+template <unsigned N, class Modem = HeraclesGsmModem>
+class GsmScheduler
+{
+public:
+    GsmScheduler()
+    {
+        _count = 0;
+        _next = 0;
+        clearStats();
+    }
+
+    bool add(Modem& modem)
+    {
+        if (_count >= N)
+            return false;
+        _modems[_count++] = &modem;
+        return true;
+    }
+
+    unsigned count(void)
+    {
+        return _count;
+    }
+
+    // Step the next modem. Returns true if it sent commands.
+    bool run(void)
+    {
+        if (!_count)
+            return false;
+        Modem* modem = _modems[_next];
+        _next = (_next + 1) % _count;
+
+        unsigned long start = micros();
+        bool busy = modem->poll();
+        unsigned long duration = micros() - start;
+
+        _stats.steps++;
+        if (busy)
+            _stats.busySteps++;
+        _stats.totalStepTime += duration;
+        if (duration > _stats.maxStepTime)
+            _stats.maxStepTime = duration;
+        return busy;
+    }
+
+    // Step each modem once
+    void runAll(void)
+    {
+        for (unsigned i = 0; i < _count; i++)
+            run();
+    }
+
+    GsmSchedulerStats stats(void)
+    {
+        GsmSchedulerStats s = _stats;
+        s.commands = 0;
+        s.bytesSent = 0;
+        s.bytesReceived = 0;
+#if GSM_ENABLE_STATS
+        for (unsigned i = 0; i < _count; i++) {
+            GsmTrafficStats t = _modems[i]->getTrafficStats();
+            s.commands += t.commands;
+            s.bytesSent += t.bytesSent;
+            s.bytesReceived += t.bytesReceived;
+        }
+#endif
+        return s;
+    }
+
+    void clearStats(void)
+    {
+        memset(&_stats, 0, sizeof(_stats));
+    }
+
+private:
+    Modem* _modems[N];
+    unsigned _count;
+    unsigned _next;
+    GsmSchedulerStats _stats;
+};
+
+#endif
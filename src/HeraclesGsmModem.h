@@ -19,6 +19,7 @@
 
 #include <Client.h>
 #include <GsmFifo.h>
+#include <GsmRxPool.h>
 
 #if defined(__AVR__)
   #define GSM_PROGMEM PROGMEM
@@ -34,11 +35,196 @@
 
 #define GSM_YIELD() { delay(0); }
 
+/*
+ * Optional feature modules. The historical ones (calls, USSD, SMS, location, battery) are enabled
+ * by default: to reduce flash and RAM footprint, define the unused ones to 0 before including this file,
+ * or define GSM_TCP_ONLY to keep only the core TCP client and network functions.
+ * The newer ones are disabled by default: define them to 1 to use them.
+ */
+#ifdef GSM_TCP_ONLY
+  #define GSM_FEATURE_DEFAULT 0
+#else
+  #define GSM_FEATURE_DEFAULT 1
+#endif
+#ifndef GSM_ENABLE_CALL
+#define GSM_ENABLE_CALL GSM_FEATURE_DEFAULT       // Phone calls and DTMF
+#endif
+#ifndef GSM_ENABLE_USSD
+#define GSM_ENABLE_USSD GSM_FEATURE_DEFAULT       // USSD codes
+#endif
+#ifndef GSM_ENABLE_SMS
+#define GSM_ENABLE_SMS GSM_FEATURE_DEFAULT        // SMS sending and reception
+#endif
+#ifndef GSM_ENABLE_LOCATION
+#define GSM_ENABLE_LOCATION GSM_FEATURE_DEFAULT   // GSM location
+#endif
+#ifndef GSM_ENABLE_BATTERY
+#define GSM_ENABLE_BATTERY GSM_FEATURE_DEFAULT    // Battery voltage and level
+#endif
+#ifndef GSM_ENABLE_DNS_CACHE
+#define GSM_ENABLE_DNS_CACHE 0                    // Host name resolution cache
+#endif
+#ifndef GSM_ENABLE_QUEUE
+#define GSM_ENABLE_QUEUE 0                        // Prioritised command queue
+#endif
+#ifndef GSM_ENABLE_RECONNECT
+#define GSM_ENABLE_RECONNECT 0                    // GsmClient automatic reconnection
+#endif
+#ifndef GSM_ENABLE_TIME
+#define GSM_ENABLE_TIME 0                         // Network time
+#endif
+#ifndef GSM_ENABLE_HTTP
+#define GSM_ENABLE_HTTP 0                         // HTTP client of the modem
+#endif
+#ifndef GSM_ENABLE_DUTY_CYCLE
+#define GSM_ENABLE_DUTY_CYCLE 0                   // Batched socket writes and modem sleep
+#endif
+#ifndef GSM_ENABLE_IDENTITY_CACHE
+#define GSM_ENABLE_IDENTITY_CACHE 0               // Modem info, IMEI and CCID read once
+#endif
+#ifndef GSM_ENABLE_REGISTRATION
+#define GSM_ENABLE_REGISTRATION 0                 // Registration and serving cell tracked from URCs
+#endif
+#ifndef GSM_ENABLE_STATS
+#define GSM_ENABLE_STATS 0                        // AT traffic and polling counters
+#endif
+
+/*
+ * Wire tracing (disabled by default): when GSM_ENABLE_TRACE is 1, commands, responses, URCs,
+ * socket data transfers and socket state changes are recorded as GsmTraceEvent in a ring buffer
+ * given to setTraceBuffer(). When disabled, the trace points compile to nothing.
+ */
+#ifndef GSM_ENABLE_TRACE
+#define GSM_ENABLE_TRACE 0
+#endif
+#if GSM_ENABLE_TRACE
+  #define GSM_TRACE(modem, type, mux, value) (modem)->trace(type, mux, value)
+#else
+  #define GSM_TRACE(modem, type, mux, value)
+#endif
+
+#if GSM_ENABLE_STATS
+  #define GSM_STATS(expr) (expr)
+#else
+  #define GSM_STATS(expr)
+#endif
+
 #define GSM_MUX_COUNT 2
 
+// Number of connections listed by AT+CIPSTATUS in multi-IP mode
+#define GSM_STATUS_ENTRIES 6
+
+// Maximum length of an AT command line accepted by the modem
+#define GSM_AT_LINE_MAX 556
+
+// Maximum number of commands in a CommandBatch
+#define GSM_BATCH_MAX_COMMANDS 8
+
+// Host name resolution cache: number of entries, and time to live (ms)
+#ifndef GSM_DNS_CACHE_SIZE
+#define GSM_DNS_CACHE_SIZE 4
+#endif
+#ifndef GSM_DNS_CACHE_TTL
+#define GSM_DNS_CACHE_TTL 3600000L
+#endif
+
+// Maximum data length requested with AT+CIPRXGET=2
+#define GSM_RX_MAX_CHUNK 1460
+
+// Maximum data length sent with one AT+CIPSEND, when it can't be queried with AT+CIPSEND?
+#define GSM_TX_MAX_CHUNK 1460
+
+// Decoding buffer of sendUSSD() returning a String (fits the longest UCS2 answer)
+#ifndef GSM_USSD_BUFFER
+#define GSM_USSD_BUFFER 256
+#endif
+
+// Number of commands queued with queueCommand(), and maximum time (ms) a management command
+// is deferred while socket data is pending
+#ifndef GSM_QUEUE_SIZE
+#define GSM_QUEUE_SIZE 4
+#endif
+#ifndef GSM_QUEUE_MAX_DEFER
+#define GSM_QUEUE_MAX_DEFER 5000L
+#endif
+
+// Number of "+CMTI:" new SMS indications queued until read with readSMS()
+#ifndef GSM_SMS_QUEUE_SIZE
+#define GSM_SMS_QUEUE_SIZE 8
+#endif
+
+// Size of each of the two buffers used by GsmClient::sendFrom()
+#ifndef GSM_UPLOAD_BUFFER
+#define GSM_UPLOAD_BUFFER 64
+#endif
+
+// Socket polling interval bounds (ms) used by maintain():
+// the interval is reset to the minimum after traffic, and doubled on each idle poll up to the maximum.
+#ifndef GSM_POLL_MIN_INTERVAL
+#define GSM_POLL_MIN_INTERVAL 100
+#endif
+#ifndef GSM_POLL_MAX_INTERVAL
+#define GSM_POLL_MAX_INTERVAL 5000
+#endif
+
+// Socket data buffered by each GsmClient between two duty cycle flushes, and time (ms) to wait
+// after pulling DTR low before the modem serial interface is usable
+#ifndef GSM_TX_BATCH_BUFFER
+#define GSM_TX_BATCH_BUFFER 128
+#endif
+#ifndef GSM_WAKE_DELAY
+#define GSM_WAKE_DELAY 50
+#endif
+
+// Shared receive buffer pool: when GSM_RX_POOL_BLOCKS is not 0, the sockets borrow blocks of
+// GSM_RX_POOL_BLOCK_SIZE bytes from a pool owned by the modem, at most GSM_RX_POOL_SOCKET_BLOCKS each
+// (by default a fair share of the pool, see also GsmClient::setRxBufferLimit()),
+// instead of each embedding a 64 bytes receive fifo.
+#ifndef GSM_RX_POOL_BLOCKS
+#define GSM_RX_POOL_BLOCKS 0
+#endif
+#ifndef GSM_RX_POOL_BLOCK_SIZE
+#define GSM_RX_POOL_BLOCK_SIZE 64
+#endif
+#ifndef GSM_RX_POOL_SOCKET_BLOCKS
+#define GSM_RX_POOL_SOCKET_BLOCKS ((GSM_RX_POOL_BLOCKS >= GSM_MUX_COUNT) ? GSM_RX_POOL_BLOCKS / GSM_MUX_COUNT : 1)
+#endif
+
+// Automatic reconnection delay bounds (ms), doubled after each failed attempt,
+// maximum host name length remembered by each GsmClient, and maximum length of the APN,
+// user name and password remembered by the modem to attach GPRS again
+#ifndef GSM_RECONNECT_MIN_DELAY
+#define GSM_RECONNECT_MIN_DELAY 1000L
+#endif
+#ifndef GSM_RECONNECT_MAX_DELAY
+#define GSM_RECONNECT_MAX_DELAY 300000L
+#endif
+#ifndef GSM_RECONNECT_HOST_MAX
+#define GSM_RECONNECT_HOST_MAX 64
+#endif
+#ifndef GSM_RECONNECT_APN_MAX
+#define GSM_RECONNECT_APN_MAX 32
+#endif
+
 #define GSM_NL "\r\n"
 static const char GSM_OK[] GSM_PROGMEM = "OK" GSM_NL;
 static const char GSM_ERROR[] GSM_PROGMEM = "ERROR" GSM_NL;
+static const char GSM_STATUS[] GSM_PROGMEM = "+CIPSTATUS";
+static const char GSM_HEX_DIGITS[] = "0123456789ABCDEF";
+
+#if GSM_ENABLE_USSD
+// GSM 7 bit default alphabet to Unicode (3GPP TS 23.038), 0x1B being the escape to the extension table
+static const uint16_t GSM_7BIT_ALPHABET[128] GSM_PROGMEM = {
+    0x0040, 0x00A3, 0x0024, 0x00A5, 0x00E8, 0x00E9, 0x00F9, 0x00EC, 0x00F2, 0x00C7, 0x000A, 0x00D8, 0x00F8, 0x000D, 0x00C5, 0x00E5,
+    0x0394, 0x005F, 0x03A6, 0x0393, 0x039B, 0x03A9, 0x03A0, 0x03A8, 0x03A3, 0x0398, 0x039E, 0x00A0, 0x00C6, 0x00E6, 0x00DF, 0x00C9,
+    0x0020, 0x0021, 0x0022, 0x0023, 0x00A4, 0x0025, 0x0026, 0x0027, 0x0028, 0x0029, 0x002A, 0x002B, 0x002C, 0x002D, 0x002E, 0x002F,
+    0x0030, 0x0031, 0x0032, 0x0033, 0x0034, 0x0035, 0x0036, 0x0037, 0x0038, 0x0039, 0x003A, 0x003B, 0x003C, 0x003D, 0x003E, 0x003F,
+    0x00A1, 0x0041, 0x0042, 0x0043, 0x0044, 0x0045, 0x0046, 0x0047, 0x0048, 0x0049, 0x004A, 0x004B, 0x004C, 0x004D, 0x004E, 0x004F,
+    0x0050, 0x0051, 0x0052, 0x0053, 0x0054, 0x0055, 0x0056, 0x0057, 0x0058, 0x0059, 0x005A, 0x00C4, 0x00D6, 0x00D1, 0x00DC, 0x00A7,
+    0x00BF, 0x0061, 0x0062, 0x0063, 0x0064, 0x0065, 0x0066, 0x0067, 0x0068, 0x0069, 0x006A, 0x006B, 0x006C, 0x006D, 0x006E, 0x006F,
+    0x0070, 0x0071, 0x0072, 0x0073, 0x0074, 0x0075, 0x0076, 0x0077, 0x0078, 0x0079, 0x007A, 0x00E4, 0x00F6, 0x00F1, 0x00FC, 0x00E0,
+};
+#endif
 
 
 enum SimStatus {
@@ -56,6 +242,128 @@ enum RegStatus {
     REG_UNKNOWN = 4,
 };
 
+// Called from the response dispatcher when the (GPRS) registration status changes:
+// modem functions must not be called from this callback.
+typedef void (*GsmRegistrationCallback)(bool gprs, RegStatus status);
+
+// Device status read by HeraclesGsmModem::getTelemetry() in a single round trip
+struct GsmTelemetry {
+    uint8_t signalQuality;      // RSSI as reported by AT+CSQ (0-31, 99 if unknown)
+    uint8_t bitErrorRate;       // 0-7, 99 if unknown
+    RegStatus registration;
+    uint16_t locationAreaCode;  // Serving cell, 0 if unknown
+    uint32_t cellId;
+    char operatorName[24];      // Empty if not registered
+    uint16_t battVoltage;       // mV
+    uint8_t battPercent;
+};
+
+// Data segment for GsmClient::writev()
+struct GsmSegment {
+    const void* data;
+    size_t len;
+};
+
+// Progress of GsmClient::sendFrom(): bytes accepted by the modem so far, out of <total>
+typedef void (*GsmProgressCallback)(size_t done, size_t total);
+
+#if GSM_ENABLE_TRACE
+enum GsmTraceType {
+    GSM_TRACE_COMMAND = 1,      // AT command line sent, value: commandId() of its (first) command
+    GSM_TRACE_RESPONSE = 2,     // Expected response, value: index of the matched response, 0 on timeout
+    GSM_TRACE_URC = 3,          // Unsolicited result code, value: GsmTraceUrc
+    GSM_TRACE_SEND = 4,         // Socket data accepted by the modem, value: bytes
+    GSM_TRACE_READ = 5,         // Socket data read from the modem, value: bytes
+    GSM_TRACE_STATE = 6,        // Socket state change, value: 1 connected, 0 closed
+};
+
+enum GsmTraceUrc {
+    GSM_URC_DATA = 1,           // "+CIPRXGET: 1"
+    GSM_URC_SMS = 2,            // "+CMTI:"
+    GSM_URC_REG = 3,            // "+CREG:"
+    GSM_URC_GPRS_REG = 4,       // "+CGREG:"
+    GSM_URC_CLOSED = 5,         // "<mux>, CLOSED"
+    GSM_URC_CONNECT = 6,        // "<mux>, CONNECT OK/FAIL" of connectAll()
+    GSM_URC_TIME = 7,           // "*PSUTTZ:" or "+CTZV:"
+};
+
+// Compact trace record (8 bytes), see HeraclesGsmModem::setTraceBuffer()
+struct GsmTraceEvent {
+    uint32_t time;      // micros()
+    uint8_t type;       // GsmTraceType
+    uint8_t mux;        // Socket, 0xFF if none
+    uint16_t value;
+};
+#endif
+
+#if GSM_RX_POOL_BLOCKS
+typedef GsmRxPool<GSM_RX_POOL_BLOCK_SIZE, GSM_RX_POOL_BLOCKS> GsmRxBlockPool;
+#endif
+
+#if GSM_ENABLE_DUTY_CYCLE
+// Drives the modem DTR pin: HIGH lets the modem sleep (once AT+CSCLK=1 is set), LOW wakes it up
+typedef void (*GsmDtrCallback)(bool high);
+
+struct GsmEnergyStats {
+    uint32_t wakeCycles;    // Wake ups from sleep
+    uint32_t awakeTime;     // Total time (ms) the modem was kept awake
+    uint32_t bytesFlushed;  // Socket data bytes sent by duty cycle flushes (bytesFlushed / wakeCycles per wake)
+};
+#endif
+
+// Called when a GsmClient connection is restored, after <attempts> reconnection attempts
+typedef void (*GsmReconnectCallback)(uint8_t mux, uint16_t attempts);
+
+struct GsmTransferStats {
+    uint32_t bytes;         // Bytes accepted by the modem
+    uint32_t elapsed;       // Transfer duration (ms)
+    uint32_t throughput;    // Achieved throughput (bytes/s)
+};
+
+#if GSM_ENABLE_SMS
+// SMS for HeraclesGsmModem::sendSMSBatch()
+struct GsmSms {
+    const char* number;
+    const void* text;   // Characters, or UTF-16 code units for a UTF-16 batch
+    size_t len;         // Number of characters / code units (0: NUL-terminated characters)
+};
+#endif
+
+#if GSM_ENABLE_SMS
+// Header of a received SMS, see HeraclesGsmModem::readSMS()
+struct GsmSmsInfo {
+    uint8_t index;          // Storage index
+    char sender[24];
+    char timestamp[24];     // "yy/MM/dd,hh:mm:ss+zz"
+};
+#endif
+
+// Priority classes of AT commands, highest first
+enum GsmPriority {
+    GSM_PRIO_DATA = 0,          // Socket data
+    GSM_PRIO_CONTROL = 1,       // Socket control and status
+    GSM_PRIO_MANAGEMENT = 2,    // Management and queries
+};
+
+// Result of a queued command: <response> is the line starting with the expected prefix (trimmed)
+typedef void (*GsmResponseCallback)(bool ok, const String& response);
+
+struct GsmTrafficStats {
+    uint32_t commands;      // AT command lines sent
+    uint32_t bytesSent;     // Socket data bytes accepted by the modem
+    uint32_t bytesReceived; // Socket data bytes received from the modem
+    uint32_t timeouts;      // Commands without expected response before their timeout
+};
+
+struct GsmPollStats {
+    uint16_t minInterval;                 // Configured minimum polling interval (ms)
+    uint16_t maxInterval;                 // Configured maximum polling interval (ms)
+    uint16_t interval[GSM_MUX_COUNT];     // Current polling interval of each socket (ms)
+    uint32_t polls;                       // Number of AT+CIPRXGET=4 sent by maintain()
+    uint32_t statusQueries;               // Number of AT+CIPSTATUS sent by maintain()
+    uint32_t wakeups;                     // Number of polls triggered by a "+CIPRXGET: 1" URC
+};
+
 /**
  * @startuml
  *   package "Arduino core" {
@@ -85,7 +393,7 @@ enum RegStatus {
  *          +connected()
  *      }
  *
- *      class HeraclesGsmModem {
+ *      class BasicHeraclesGsmModem<SerialT> {
  *        +setBaud(baud)
  *        +init()
  *        +attachGPRS()
@@ -93,23 +401,30 @@ enum RegStatus {
  *        +...()
  *      }
  *
- *      GsmClient "0..2" --o "1" HeraclesGsmModem
+ *      class HeraclesGsmModem <<typedef BasicHeraclesGsmModem<Stream>>>
+ *
+ *      GsmClient "0..2" --o "1" BasicHeraclesGsmModem
+ *      BasicHeraclesGsmModem <|-- HeraclesGsmModem
  *   }
  *
  *   Client <|-right- GsmClient
- *   Stream "1" --o HeraclesGsmModem
+ *   Stream "1" --o BasicHeraclesGsmModem
  * @enduml
+ *
+ * SerialT is the type of the modem serial interface. HeraclesGsmModem uses any Stream;
+ * SerialT may be any class providing the Stream members used by the library.
  */
-class HeraclesGsmModem {
+template <class SerialT = Stream>
+class BasicHeraclesGsmModem {
 
 public:
 
     class GsmClient: public Client {
-        friend class HeraclesGsmModem;
+        friend class BasicHeraclesGsmModem;
 
     public:
 
-        GsmClient(HeraclesGsmModem& modem, uint8_t mux = 0, bool sslEnabled = true) {
+        GsmClient(BasicHeraclesGsmModem& modem, uint8_t mux = 0, bool sslEnabled = true) {
             init(&modem, mux, sslEnabled);
         }
 
@@ -120,12 +435,17 @@ public:
          *    participant GsmClient as "GsmClient\n(library)"
          *    participant HeraclesGsmModem as "HeraclesGsmModem\n(library)"
          *    UserApp -> GsmClient : connect(<host>, <port>)
-         *    GsmClient -> HeraclesGsmModem : modemConnect(<host>, <port>, <mux>, <ssl>)
+         *    GsmClient -> HeraclesGsmModem : modemConnectHost(<host>, <port>, <mux>, <ssl>)
+         *    alt If SSL is disabled and <host> is not in DNS cache
+         *       HeraclesGsmModem -> Stream : "AT+CDNSGIP=<host>"
+         *       note right : Resolve host name
+         *       HeraclesGsmModem <-- Stream : "+CDNSGIP: 1,<host>,<ip>"
+         *    end
          *    HeraclesGsmModem -> Stream : "AT+CIPSSL=<ssl>"
          *    note right : Enable or disable SSL function
          *    HeraclesGsmModem <-- Stream : "OK"
-         *    HeraclesGsmModem -> Stream : "AT+CIPSTART=<mux>,TCP,<host>,<port>"
-         *    note right : Start up the connection
+         *    HeraclesGsmModem -> Stream : "AT+CIPSTART=<mux>,TCP,<ip>,<port>"
+         *    note right : Start up the connection (with <host> if SSL is enabled).\nIf it fails, the connection is retried with <host>,\nwhich is used for the next connections.
          *    HeraclesGsmModem <-- Stream : "CONNECT OK"
          *    note left : The TCP connection has been established successfully.\nSSL certificate handshake finished.
          *    GsmClient <-- HeraclesGsmModem : status
@@ -135,21 +455,28 @@ public:
         virtual int connect(const char *host, uint16_t port) {
             GSM_YIELD();
             rx.clear();
+#if GSM_ENABLE_DUTY_CYCLE
+            tx_batch_len = 0;
+#endif
+#if GSM_ENABLE_RECONNECT
+            reconnectRemember(host, port);
+#endif
 
-            sock_connected = at->modemConnect(host, port, mux, ssl_enabled);
+            sock_connected = at->modemConnectHost(host, port, mux, ssl_enabled);
+            tx_max = 0; // Queried on first send
+            prev_check = millis();
+            poll_interval = at->poll_min;
+#if GSM_ENABLE_RECONNECT
+            if (sock_connected) {
+                reconnect_armed = auto_reconnect && reconnect_port;
+            }
+#endif
+            GSM_TRACE(at, GSM_TRACE_STATE, mux, sock_connected);
             return sock_connected;
         }
 
         virtual int connect(IPAddress ip, uint16_t port) {
-            String host;
-            host.reserve(16);
-            host += ip[0];
-            host += ".";
-            host += ip[1];
-            host += ".";
-            host += ip[2];
-            host += ".";
-            host += ip[3];
+            String host = ipToString(ip);
             return connect(host.c_str(), port);
         }
 
@@ -169,8 +496,17 @@ public:
          */
         virtual void stop() {
             GSM_YIELD();
+#if GSM_ENABLE_RECONNECT
+            reconnect_armed = false;
+            reconnect_delay = 0;
+            reconnect_attempts = 0;
+#endif
+#if GSM_ENABLE_DUTY_CYCLE
+            at->flushBatch(this);
+#endif
             at->sendAT(GF("+CIPCLOSE="), mux);
             sock_connected = false;
+            GSM_TRACE(at, GSM_TRACE_STATE, mux, 0);
             at->waitResponse();
             rx.clear();
         }
@@ -182,23 +518,49 @@ public:
          *    participant GsmClient as "GsmClient\n(library)"
          *    participant HeraclesGsmModem as "HeraclesGsmModem\n(library)"
          *    UserApp -> GsmClient : write(<buf>, <size>)
-         *    GsmClient -> HeraclesGsmModem : maintain()
+         *    GsmClient -> HeraclesGsmModem : handleUrc()
          *    GsmClient -> HeraclesGsmModem : modemSend(<buf>, <size>, <mux>)
-         *    HeraclesGsmModem -> Stream : "AT+CIPSEND=<mux>,<size>"
-         *    note right : Write command
-         *    HeraclesGsmModem <-- Stream : ">"
-         *    HeraclesGsmModem -> Stream : write(<buf>, <size>)
-         *    note right : Provide data to send
-         *    HeraclesGsmModem -> Stream : flush()
-         *    HeraclesGsmModem <-- Stream : "DATA ACCEPT:"
-         *    note left : Sending is successful
+         *    opt first write on this connection
+         *      HeraclesGsmModem -> Stream : "AT+CIPSEND?"
+         *      note right : Query maximum data length of each connection
+         *      HeraclesGsmModem <-- Stream : "+CIPSEND: <mux>,<max size>"
+         *    end
+         *    loop for each chunk of at most <max size> bytes
+         *      HeraclesGsmModem -> Stream : "AT+CIPSEND=<mux>,<chunk size>"
+         *      note right : Write command
+         *      HeraclesGsmModem <-- Stream : ">"
+         *      HeraclesGsmModem -> Stream : write(<chunk>, <chunk size>)
+         *      note right : Provide data to send
+         *      HeraclesGsmModem -> Stream : flush()
+         *      HeraclesGsmModem <-- Stream : "DATA ACCEPT:"
+         *      note left : Sending is successful
+         *    end loop
          *    GsmClient <-- HeraclesGsmModem : status
          *    UserApp <-- GsmClient : status
          * @enduml
          */
         virtual size_t write(const uint8_t *buf, size_t size) {
+#if GSM_ENABLE_DUTY_CYCLE
+            if (at->duty_period) {
+                if (!sock_connected) {
+                    return 0; // Nothing could be flushed
+                }
+                // Buffered until the next flush, sent directly only if larger than the buffer
+                if (tx_batch_len + size > sizeof(tx_batch)) {
+                    at->flushBatch(this);
+                }
+                if (tx_batch_len + size <= sizeof(tx_batch)) {
+                    memcpy(tx_batch + tx_batch_len, buf, size);
+                    tx_batch_len += size;
+                    return size;
+                }
+                if (tx_batch_len) {
+                    return 0;
+                }
+            }
+#endif
             GSM_YIELD();
-            at->maintain();
+            at->handleUrc(); // Socket data goes before status polls and queued commands
             return at->modemSend(buf, size, mux);
         }
 
@@ -206,6 +568,40 @@ public:
             return write(&c, 1);
         }
 
+        /*
+         * Write <count> data segments (e.g. protocol header and payload) without copying them
+         * in a staging buffer: segments are streamed in the same AT+CIPSEND transaction,
+         * split in several transactions only if the total exceeds the connection maximum send size.
+         * Returns the number of bytes accepted by the modem.
+         */
+        size_t writev(const GsmSegment* segments, uint8_t count) {
+            GSM_YIELD();
+#if GSM_ENABLE_DUTY_CYCLE
+            if (!at->flushBatch(this)) {
+                return 0;
+            }
+#endif
+            at->handleUrc();
+            return at->modemSendv(segments, count, mux);
+        }
+
+        /*
+         * Upload <len> bytes read from <src> (e.g. a file on SD card).
+         * The next block is read from <src> while the current one is being transmitted to the modem.
+         * If <src> runs dry, the AT+CIPSEND transaction in progress is cancelled and the upload stops.
+         * Returns the number of bytes accepted by the modem.
+         */
+        size_t sendFrom(Stream& src, size_t len, GsmProgressCallback progress = NULL, GsmTransferStats* stats = NULL) {
+            GSM_YIELD();
+#if GSM_ENABLE_DUTY_CYCLE
+            if (!at->flushBatch(this)) {
+                return 0;
+            }
+#endif
+            at->handleUrc();
+            return at->modemSendFrom(src, len, mux, progress, stats);
+        }
+
         virtual int available() {
             GSM_YIELD();
             if (!rx.size() && sock_connected) {
@@ -223,12 +619,14 @@ public:
          *    participant HeraclesGsmModem as "HeraclesGsmModem\n(library)"
          *    UserApp -> GsmClient : read(<buf>, size)
          *    GsmClient -> HeraclesGsmModem : maintain()
-         *    GsmClient -> HeraclesGsmModem : modemRead(...)
+         *    GsmClient -> HeraclesGsmModem : modemRead(<size>, <mux>, <buf>, <remaining>)
          *    HeraclesGsmModem -> Stream : "AT+CIPRXGET=2,<mux>,<size>"
-         *    note right : Get Data from Network Manually
+         *    note right : Get Data from Network Manually.\n<size> is the remaining user buffer size\n(at least the rx fifo size, at most GSM_RX_MAX_CHUNK)
+         *    HeraclesGsmModem -> Stream : stream.readBytes(<buf>, ...)
+         *    HeraclesGsmModem <-- Stream : received data, copied to user buffer
          *    loop while a char is available
          *      HeraclesGsmModem -> Stream : stream.read()
-         *      HeraclesGsmModem <-- Stream : received char
+         *      HeraclesGsmModem <-- Stream : residual tail, stored in rx fifo
          *    end loop
          *    HeraclesGsmModem <-- Stream : "OK"
          *    GsmClient <-- HeraclesGsmModem : number of bytes read
@@ -250,7 +648,15 @@ public:
                 }
                 at->maintain();
                 if (sock_available > 0) {
-                    at->modemRead(rx.free(), mux);
+                    // rx fifo is empty here: data is streamed straight into the user buffer,
+                    // only the residual tail (if any) is kept in the fifo.
+                    size_t remaining = size - cnt;
+                    size_t len = at->modemRead(remaining, mux, buf, remaining);
+                    if (len > remaining) {
+                        len = remaining;
+                    }
+                    buf += len;
+                    cnt += len;
                 }
                 else {
                     break;
@@ -272,6 +678,9 @@ public:
         }
 
         virtual void flush() {
+#if GSM_ENABLE_DUTY_CYCLE
+            at->flushBatch(this);
+#endif
             at->stream.flush();
         }
 
@@ -287,36 +696,255 @@ public:
             return connected();
         }
 
+#if GSM_RX_POOL_BLOCKS
+        /*
+         * Maximum number of receive pool blocks used by this client (at most GSM_RX_POOL_SOCKET_BLOCKS):
+         * received data is read ahead up to this limit, a lower one leaves more blocks to the other clients.
+         */
+        void setRxBufferLimit(uint8_t blocks) {
+            rx.setLimit(blocks);
+        }
+#endif
+
+#if GSM_ENABLE_RECONNECT
+        /*
+         * Opt-in automatic reconnection: once connected, a connection lost without stop() is opened again
+         * by maintain()/poll() to the same host, port and SSL mode. Attempts are spaced by an exponential
+         * backoff from GSM_RECONNECT_MIN_DELAY to GSM_RECONNECT_MAX_DELAY ms, each delay being randomly
+         * shortened by up to half so that a fleet of devices doesn't reconnect at the same time
+         * (the generator is seeded with the IMEI of the modem, random() is not used).
+         * If <reattach>, GPRS is attached again when the bearer dropped, with the APN and credentials
+         * of the last attachGPRS(apn, user, pwd), or with attachGPRS() if it was used.
+         */
+        void setAutoReconnect(bool enable, bool reattach = false, GsmReconnectCallback callback = NULL) {
+            auto_reconnect = enable;
+            reconnect_reattach = reattach;
+            reconnect_callback = callback;
+            if (!enable) {
+                reconnect_armed = false;
+                reconnect_delay = 0;
+                reconnect_attempts = 0;
+            }
+        }
+#endif
+
     private:
 
-        bool init(HeraclesGsmModem* modem, uint8_t mux, bool sslEnabled) {
+        bool init(BasicHeraclesGsmModem* modem, uint8_t mux, bool sslEnabled) {
             this->at = modem;
             this->mux = mux;
             ssl_enabled = sslEnabled;
             sock_available = 0;
             sock_connected = false;
+            connect_pending = false;
+            poll_interval = GSM_POLL_MIN_INTERVAL;
+            prev_check = 0;
+            tx_max = 0;
+#if GSM_ENABLE_RECONNECT
+            auto_reconnect = false;
+            reconnect_reattach = false;
+            reconnect_armed = false;
+            reconnect_host[0] = 0;
+            reconnect_port = 0;
+            reconnect_delay = 0;
+            reconnect_at = 0;
+            reconnect_attempts = 0;
+            reconnect_callback = NULL;
+#endif
+#if GSM_ENABLE_DUTY_CYCLE
+            tx_batch_len = 0;
+#endif
 
             at->sockets[mux] = this;
+#if GSM_RX_POOL_BLOCKS
+            rx.init(&at->rx_pool);
+#endif
 
             return true;
         }
 
+#if GSM_ENABLE_RECONNECT
+        // Host and port of the connection, if automatic reconnection is enabled and the host name fits
+        void reconnectRemember(const char* host, uint16_t port) {
+            if (!auto_reconnect || host == reconnect_host) {
+                return;
+            }
+            if (strlen(host) < sizeof(reconnect_host)) {
+                strcpy(reconnect_host, host);
+                reconnect_port = port;
+            }
+            else {
+                reconnect_port = 0;
+            }
+        }
+#endif
+
+#if GSM_RX_POOL_BLOCKS
+        typedef GsmPooledFifo<GsmRxBlockPool, GSM_RX_POOL_SOCKET_BLOCKS> RxFifo;
+#else
         typedef GsmFifo<uint8_t, 64> RxFifo;
+#endif
 
-        HeraclesGsmModem* at;
+        BasicHeraclesGsmModem* at;
         uint8_t mux;
         uint16_t sock_available;
+        uint16_t tx_max;
+        uint16_t poll_interval;
+        uint32_t prev_check;
         bool sock_connected;
+        bool connect_pending;
         bool ssl_enabled;
         RxFifo rx;
+#if GSM_ENABLE_RECONNECT
+        bool auto_reconnect;
+        bool reconnect_reattach;
+        bool reconnect_armed;           // Connected once since enabled, and not stopped
+        char reconnect_host[GSM_RECONNECT_HOST_MAX];
+        uint16_t reconnect_port;
+        uint32_t reconnect_delay;       // Current backoff delay, 0 while connected
+        uint32_t reconnect_at;          // Time of the next attempt
+        uint16_t reconnect_attempts;
+        GsmReconnectCallback reconnect_callback;
+#endif
+#if GSM_ENABLE_DUTY_CYCLE
+        uint8_t tx_batch[GSM_TX_BATCH_BUFFER];
+        uint16_t tx_batch_len;
+#endif
+    };
+
+    /*
+     * Independent settings commands, sent chained on as few AT command lines as possible
+     * (e.g. "AT+CIPMODE=0;+CIPMUX=1;+CIPQSEND=1;+CIPRXGET=1"). See sendBatch().
+     * Each command is <prefix><param><suffix>, where only <param> is a RAM string.
+     */
+    class CommandBatch {
+        friend class BasicHeraclesGsmModem;
+
+    public:
+
+        CommandBatch() {
+            clear();
+        }
+
+        void clear() {
+            count = 0;
+            failed = -1;
+        }
+
+        bool add(GsmConstStr prefix, const char* param = NULL, GsmConstStr suffix = NULL) {
+            if (count >= GSM_BATCH_MAX_COMMANDS) {
+                return false;
+            }
+            cmds[count].prefix = prefix;
+            cmds[count].param = param;
+            cmds[count].suffix = suffix;
+            count++;
+            return true;
+        }
+
+        uint8_t size() const {
+            return count;
+        }
+
+        // Index of the command which failed in the last sendBatch(), -1 if none
+        int8_t failedIndex() const {
+            return failed;
+        }
+
+    private:
+
+        struct Command {
+            GsmConstStr prefix;
+            const char* param;
+            GsmConstStr suffix;
+        };
+
+        // Extended commands ("+XXX") must be followed by ';' when chained, basic commands don't
+        bool isExtended(uint8_t i) const {
+            return gsmStrFirst(cmds[i].prefix) == '+';
+        }
+
+        size_t length(uint8_t i) const {
+            size_t len = gsmStrLen(cmds[i].prefix);
+            if (cmds[i].param) {
+                len += strlen(cmds[i].param);
+            }
+            if (cmds[i].suffix) {
+                len += gsmStrLen(cmds[i].suffix);
+            }
+            return len;
+        }
+
+        Command cmds[GSM_BATCH_MAX_COMMANDS];
+        uint8_t count;
+        int8_t failed;
     };
 
 public:
 
-    HeraclesGsmModem(Stream& stream, bool dnsEnabled = true) : stream(stream), dns_enabled(dnsEnabled)
+    BasicHeraclesGsmModem(SerialT& stream, bool dnsEnabled = true) : stream(stream), dns_enabled(dnsEnabled)
     {
         memset(sockets, 0, sizeof(sockets));
-        prev_check = 0;
+#if GSM_ENABLE_IDENTITY_CACHE
+        memset(modem_info, 0, sizeof(modem_info));
+        memset(modem_imei, 0, sizeof(modem_imei));
+        memset(sim_ccid, 0, sizeof(sim_ccid));
+#endif
+#if GSM_ENABLE_STATS
+        memset(&poll_stats, 0, sizeof(poll_stats));
+        memset(&traffic_stats, 0, sizeof(traffic_stats));
+#endif
+#if GSM_ENABLE_QUEUE
+        memset(cmd_queue, 0, sizeof(cmd_queue));
+        memset(&cmd_inflight, 0, sizeof(cmd_inflight));
+        inflight_state = INFLIGHT_LINE;
+        cmd_seq = 0;
+#endif
+        poll_next = 0;
+        connecting = 0;
+        poll_min = GSM_POLL_MIN_INTERVAL;
+        poll_max = GSM_POLL_MAX_INTERVAL;
+#if GSM_ENABLE_REGISTRATION
+        reg_urc = false;
+        reg_known = false;
+        gprs_reg_known = false;
+        reg_status = REG_UNKNOWN;
+        gprs_reg_status = REG_UNKNOWN;
+        reg_lac = 0;
+        reg_ci = 0;
+        reg_callback = NULL;
+#endif
+#if GSM_ENABLE_TRACE
+        trace_buf = NULL;
+        trace_size = 0;
+        trace_head = 0;
+        trace_count = 0;
+#endif
+#if GSM_ENABLE_TIME
+        time_epoch = 0;
+        time_millis = 0;
+        time_zone = 0;
+#endif
+#if GSM_ENABLE_DUTY_CYCLE
+        duty_period = 0;
+        duty_threshold = GSM_TX_BATCH_BUFFER;
+        duty_last = 0;
+        wake_start = 0;
+        dtr_hook = NULL;
+        sleep_enabled = false;
+        modem_sleeping = false;
+        memset(&energy_stats, 0, sizeof(energy_stats));
+#endif
+#if GSM_ENABLE_DNS_CACHE
+        memset(dns_cache, 0, sizeof(dns_cache));
+#endif
+#if GSM_ENABLE_RECONNECT
+        reconnect_seed = 0;
+        gprs_apn[0] = 0;
+        gprs_user[0] = 0;
+        gprs_pwd[0] = 0;
+#endif
+        setDnsServers("8.8.8.8", "8.8.4.4");
     }
 
     /*
@@ -327,14 +955,23 @@ public:
         if (!testAT()) {
             return false;
         }
-        sendAT(GF("&F0"));  // Set all TA parameters to manufacturer defaults
-        if (waitResponse(10000L) != 1) {
+        CommandBatch batch;
+        batch.add(GF("&F0"));   // Set all TA parameters to manufacturer defaults
+        batch.add(GF("E0"));    // Echo Off
+#if GSM_ENABLE_REGISTRATION
+        batch.add(GF("+CREG=2"));   // Registration URC, with location information
+        batch.add(GF("+CGREG=2"));  // GPRS registration URC, with location information
+        reg_known = false;
+        gprs_reg_known = false;
+        reg_urc = sendBatch(batch, 10000L);
+        if (!reg_urc && batch.failedIndex() < 2) {
             return false;
         }
-        sendAT(GF("E0"));   // Echo Off
-        if (waitResponse() != 1) {
+#else
+        if (!sendBatch(batch, 10000L)) {
             return false;
         }
+#endif
         getSimStatus();
         return true;
     }
@@ -355,73 +992,225 @@ public:
         return false;
     }
 
+    /*
+     * Poll the connected sockets, each one with its own adaptive interval:
+     * short after traffic, exponential backoff while idle, immediate on "+CIPRXGET: 1" URC.
+     * When a polled socket has no pending data, the state of all connections
+     * is refreshed with a single AT+CIPSTATUS.
+     */
     void maintain() {
-        if (millis() - prev_check > 500) {
-            prev_check = millis();
-            for (int mux = 0; mux < GSM_MUX_COUNT; mux++) {
-                GsmClient* sock = sockets[mux];
-                if (sock) {
-                    sock->sock_available = modemGetAvailable(mux);
-                }
+#if GSM_ENABLE_DUTY_CYCLE
+        if (duty_period && !commandInFlight()
+                && (batchedBytes() >= duty_threshold || millis() - duty_last >= duty_period)) {
+            flushBatches();
+        }
+#endif
+        bool checkStatus = false;
+        for (int mux = 0; mux < GSM_MUX_COUNT; mux++) {
+            if (pollDue(mux) && !pollSocket(mux)) {
+                checkStatus = true;
             }
         }
 
-        while (stream.available()) {
-            waitResponse(10, NULL, NULL);
+        if (checkStatus) {
+            refreshStatus();
         }
-    }
 
-    bool factoryDefault() {
-        sendAT(GF("&FZE0&W"));  // Factory + Reset + Echo Off + Write
-        waitResponse();
-        sendAT(GF("+IPR=0"));   // Auto-baud
-        waitResponse();
-        sendAT(GF("+IFC=0,0")); // No Flow Control
-        waitResponse();
-        sendAT(GF("+ICF=3,3")); // 8 data 0 parity 1 stop
-        waitResponse();
-        sendAT(GF("+CSCLK=0")); // Disable Slow Clock
-        waitResponse();
-        sendAT(GF("&W"));       // Write configuration
-        return waitResponse() == 1;
-    }
+#if GSM_ENABLE_RECONNECT
+        for (int mux = 0; mux < GSM_MUX_COUNT; mux++) {
+            reconnectSocket(mux);
+        }
+#endif
 
-    String getModemInfo() {
-        sendAT(GF("I"));
-        String res;
-        if (waitResponse(1000L, res) != 1) {
-            return "";
+        handleUrc();
+#if GSM_ENABLE_QUEUE
+        dispatchQueued();
+#endif
+#if GSM_ENABLE_DUTY_CYCLE
+        if (dtr_hook && duty_period && !modem_sleeping && !socketDataPending() && !commandInFlight()) {
+            modemSleep();
         }
-        res.replace(GSM_NL "OK" GSM_NL, "");
-        res.replace(GSM_NL, " ");
-        res.trim();
-        return res;
+#endif
     }
 
     /*
-     * Power functions
+     * Short step, to drive several modems from one event loop (see GsmScheduler):
+     * process the URCs already received (waiting at most 1 ms for more),
+     * then poll at most one socket (round robin) if it is due, or else send the next queued command.
+     * It is not non-blocking: a socket poll waits for its AT+CIPRXGET=4 round trip (a few ms at 115200 bauds,
+     * at most 1 s without answer), followed without GSM_ENABLE_QUEUE by an AT+CIPSTATUS round trip (at most 1 s
+     * more); with the queue, the status refresh and queued commands are sent without waiting for their response.
+     * With GSM_ENABLE_RECONNECT, a step reconnecting a socket blocks for the whole connection
+     * (up to the 75 s AT+CIPSTART timeout, plus the GPRS attachment if it was lost).
+     * Returns true if commands were sent to the modem.
      */
-
-    bool restart() {
-        if (!testAT()) {
-            return false;
-        }
-
-        sendAT(GF("+CFUN=0"));
-        if (waitResponse(10000L) != 1) {
-            return false;
+    bool poll() {
+        if (stream.available()) {
+            waitResponse(1, NULL, NULL);
+        }
+        for (int i = 0; i < GSM_MUX_COUNT; i++) {
+            uint8_t mux = poll_next;
+            poll_next = (poll_next + 1) % GSM_MUX_COUNT;
+            if (pollDue(mux)) {
+                if (!pollSocket(mux)) {
+                    refreshStatus();
+                }
+                return true;
+            }
         }
-        sendAT(GF("+CFUN=1,1"));
-        if (waitResponse(10000L) != 1) {
-            return false;
+#if GSM_ENABLE_RECONNECT
+        for (int mux = 0; mux < GSM_MUX_COUNT; mux++) {
+            if (reconnectSocket(mux)) {
+                return true;
+            }
         }
-        delay(3000);
-        return init();
-    }
-
-    bool poweroff() {
-        sendAT(GF("+CPOWD=1"));
-        return waitResponse(GF("NORMAL POWER DOWN")) == 1;
+#endif
+#if GSM_ENABLE_QUEUE
+        return dispatchQueued();
+#else
+        return false;
+#endif
+    }
+
+#if GSM_ENABLE_QUEUE
+    /*
+     * Queue a command, sent by maintain()/poll() in priority order, one at a time:
+     * management commands are deferred while socket data is pending (at most GSM_QUEUE_MAX_DEFER ms).
+     * The command is sent without waiting for its response, which is picked by the response dispatcher
+     * and given to <callback> by a later maintain()/poll() (with ok false if not received within <timeout> ms).
+     * As the modem handles one command at a time, socket polls wait meanwhile, and a synchronous command
+     * (e.g. the AT+CIPSEND of GsmClient::write()) waits for the response first.
+     * <prefix> is the start of the response line given to <callback> (e.g. GSM_NL "+CSQ:"), or NULL.
+     * The library queues the status refresh of idle connections as GSM_PRIO_CONTROL.
+     */
+    bool queueCommand(GsmPriority priority, GsmConstStr cmd, GsmConstStr prefix, GsmResponseCallback callback,
+            uint32_t timeout = 1000L) {
+        for (int i = 0; i < GSM_QUEUE_SIZE; i++) {
+            QueuedCommand& q = cmd_queue[i];
+            if (!q.cmd) {
+                q.cmd = cmd;
+                q.prefix = prefix;
+                q.callback = callback;
+                q.timeout = timeout;
+                q.priority = priority;
+                q.queued = millis();
+                q.seq = cmd_seq++;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    size_t queuedCommands() {
+        size_t n = 0;
+        for (int i = 0; i < GSM_QUEUE_SIZE; i++) {
+            if (cmd_queue[i].cmd) {
+                n++;
+            }
+        }
+        return n;
+    }
+#endif
+
+#if GSM_ENABLE_STATS
+    /*
+     * Counters of the AT traffic since the creation of the modem object or the last clearTrafficStats().
+     * Compare the commands of an operation with its budget in README to detect extra round trips.
+     */
+    GsmTrafficStats getTrafficStats() {
+        return traffic_stats;
+    }
+
+    void clearTrafficStats() {
+        memset(&traffic_stats, 0, sizeof(traffic_stats));
+    }
+
+    GsmPollStats getPollStats() {
+        poll_stats.minInterval = poll_min;
+        poll_stats.maxInterval = poll_max;
+        for (int mux = 0; mux < GSM_MUX_COUNT; mux++) {
+            poll_stats.interval[mux] = sockets[mux] ? sockets[mux]->poll_interval : 0;
+        }
+        return poll_stats;
+    }
+#endif
+
+    void setPollInterval(uint16_t minInterval, uint16_t maxInterval) {
+        if (maxInterval < minInterval) {
+            maxInterval = minInterval;
+        }
+        poll_min = minInterval;
+        poll_max = maxInterval;
+        for (int mux = 0; mux < GSM_MUX_COUNT; mux++) {
+            if (sockets[mux]) {
+                sockets[mux]->poll_interval = minInterval;
+            }
+        }
+    }
+
+    // The registration URCs are disabled by the reset: the status is queried again until the next init()
+    bool factoryDefault() {
+        sendAT(GF("&FZE0&W"));  // Factory + Reset + Echo Off + Write
+        waitResponse();
+#if GSM_ENABLE_REGISTRATION
+        reg_urc = false;
+        reg_known = false;
+        gprs_reg_known = false;
+#endif
+        CommandBatch batch;
+        batch.add(GF("+IPR=0"));    // Auto-baud
+        batch.add(GF("+IFC=0,0"));  // No Flow Control
+        batch.add(GF("+ICF=3,3"));  // 8 data 0 parity 1 stop
+        batch.add(GF("+CSCLK=0"));  // Disable Slow Clock
+        batch.add(GF("&W"));        // Write configuration
+        return sendBatch(batch);
+    }
+
+    // Read once, then cached (read each time without GSM_ENABLE_IDENTITY_CACHE)
+    String getModemInfo() {
+#if GSM_ENABLE_IDENTITY_CACHE
+        if (modem_info[0]) {
+            return modem_info;
+        }
+#endif
+        sendAT(GF("I"));
+        String res;
+        if (waitResponse(1000L, res) != 1) {
+            return "";
+        }
+        res.replace(GSM_NL "OK" GSM_NL, "");
+        res.replace(GSM_NL, " ");
+        res.trim();
+#if GSM_ENABLE_IDENTITY_CACHE
+        strncpy(modem_info, res.c_str(), sizeof(modem_info) - 1);
+#endif
+        return res;
+    }
+
+    /*
+     * Power functions
+     */
+
+    bool restart() {
+        if (!testAT()) {
+            return false;
+        }
+
+        sendAT(GF("+CFUN=0"));
+        if (waitResponse(10000L) != 1) {
+            return false;
+        }
+        sendAT(GF("+CFUN=1,1"));
+        if (waitResponse(10000L) != 1) {
+            return false;
+        }
+        delay(3000);
+        return init();
+    }
+
+    bool poweroff() {
+        sendAT(GF("+CPOWD=1"));
+        return waitResponse(GF("NORMAL POWER DOWN")) == 1;
     }
 
     bool radioOff() {
@@ -452,6 +1241,9 @@ public:
         if (waitResponse() != 1) {
             return false;
         }
+#if GSM_ENABLE_IDENTITY_CACHE
+        sim_ccid[0] = 0;
+#endif
         sendAT(GF("&W"));
         if (waitResponse() != 1) {
             return false;
@@ -467,6 +1259,9 @@ public:
         if (waitResponse() != 1) {
             return false;
         }
+#if GSM_ENABLE_IDENTITY_CACHE
+        sim_ccid[0] = 0;
+#endif
         sendAT(GF("&W"));
         if (waitResponse() != 1) {
             return false;
@@ -482,7 +1277,14 @@ public:
         return waitResponse() == 1;
     }
 
+    // Read once, then cached until the SIM card is changed with setInternalSim()/setExternalSim()
+    // (read each time without GSM_ENABLE_IDENTITY_CACHE)
     String getSimCCID() {
+#if GSM_ENABLE_IDENTITY_CACHE
+        if (sim_ccid[0]) {
+            return sim_ccid;
+        }
+#endif
         sendAT(GF("+ICCID"));
         if (waitResponse(GF(GSM_NL "+ICCID:")) != 1) {
             return "";
@@ -490,10 +1292,19 @@ public:
         String res = stream.readStringUntil('\n');
         waitResponse();
         res.trim();
+#if GSM_ENABLE_IDENTITY_CACHE
+        strncpy(sim_ccid, res.c_str(), sizeof(sim_ccid) - 1);
+#endif
         return res;
     }
 
+    // Read once, then cached (read each time without GSM_ENABLE_IDENTITY_CACHE)
     String getIMEI() {
+#if GSM_ENABLE_IDENTITY_CACHE
+        if (modem_imei[0]) {
+            return modem_imei;
+        }
+#endif
         sendAT(GF("+GSN"));
         if (waitResponse(GF(GSM_NL)) != 1) {
             return "";
@@ -501,6 +1312,9 @@ public:
         String res = stream.readStringUntil('\n');
         waitResponse();
         res.trim();
+#if GSM_ENABLE_IDENTITY_CACHE
+        strncpy(modem_imei, res.c_str(), sizeof(modem_imei) - 1);
+#endif
         return res;
     }
 
@@ -526,17 +1340,46 @@ public:
         return SIM_ERROR;
     }
 
+    /*
+     * Registration status is tracked from "+CREG:" URCs (enabled by init()),
+     * the modem is only queried until the first status is known.
+     * Without GSM_ENABLE_REGISTRATION, the modem is queried on each call.
+     */
     RegStatus getRegistrationStatus() {
-        sendAT(GF("+CREG?"));
-        if (waitResponse(GF(GSM_NL "+CREG:")) != 1) {
-            return REG_UNKNOWN;
+#if GSM_ENABLE_REGISTRATION
+        if (reg_urc && reg_known) {
+            handleUrc();
+            return reg_status;
         }
-        streamSkipUntil(','); // Skip format (0)
-        int status = stream.readStringUntil('\n').toInt();
-        waitResponse();
-        return (RegStatus) status;
+#endif
+        return queryRegistration(false);
+    }
+
+    RegStatus getGprsRegistrationStatus() {
+#if GSM_ENABLE_REGISTRATION
+        if (reg_urc && gprs_reg_known) {
+            handleUrc();
+            return gprs_reg_status;
+        }
+#endif
+        return queryRegistration(true);
+    }
+
+#if GSM_ENABLE_REGISTRATION
+    // Location area code and cell ID of the serving cell, from the last registration report
+    uint16_t getLocationAreaCode() {
+        return reg_lac;
+    }
+
+    uint32_t getCellId() {
+        return reg_ci;
     }
 
+    void setRegistrationCallback(GsmRegistrationCallback callback) {
+        reg_callback = callback;
+    }
+#endif
+
     String getOperator() {
         sendAT(GF("+COPS?"));
         if (waitResponse(GF(GSM_NL "+COPS:")) != 1) {
@@ -562,6 +1405,68 @@ public:
         return res;
     }
 
+    /*
+     * Read signal quality, registration, operator and battery status with a single
+     * AT+CSQ;+CREG?;+COPS?;+CBC command, parsing each result line as it arrives from a stack buffer.
+     * This is not allocation free: the response dispatcher matches the result prefixes in a String,
+     * allocated once (64 bytes) and reused for the whole response.
+     * With GSM_ENABLE_REGISTRATION, the tracked registration status and serving cell are also updated
+     * (see getRegistrationStatus()).
+     */
+    bool getTelemetry(GsmTelemetry& telemetry) {
+        memset(&telemetry, 0, sizeof(telemetry));
+        telemetry.signalQuality = 99;
+        telemetry.bitErrorRate = 99;
+        telemetry.registration = REG_UNKNOWN;
+
+        sendAT(GF("+CSQ;+CREG?;+COPS?;+CBC"));
+        String data;    // Dispatcher buffer, shared by all the result lines
+        char line[48];
+        while (true) {
+            data = "";
+            uint8_t rsp = waitResponse(1000L, data, GF(GSM_NL "+CSQ:"), GF(GSM_NL "+CREG:"), GF(GSM_NL "+COPS:"),
+                                       GF(GSM_NL "+CBC:"), GFP(GSM_ERROR));
+            if (rsp == 0 || rsp == 5) {
+                return false;
+            }
+            streamReadLine(line, sizeof(line));
+            if (rsp == 1) {
+                telemetry.signalQuality = atoi(line);
+                const char* ber = strchr(line, ',');
+                telemetry.bitErrorRate = ber ? atoi(ber + 1) : 99;
+            }
+            else if (rsp == 2) {
+                telemetry.registration = parseRegistration(line, &telemetry.locationAreaCode, &telemetry.cellId);
+#if GSM_ENABLE_REGISTRATION
+                updateRegistration(false, line);
+#endif
+            }
+            else if (rsp == 3) {
+                const char* name = strchr(line, '"');
+                if (name) {
+                    name++;
+                    size_t len = strcspn(name, "\"");
+                    if (len >= sizeof(telemetry.operatorName)) {
+                        len = sizeof(telemetry.operatorName) - 1;
+                    }
+                    memcpy(telemetry.operatorName, name, len);
+                }
+            }
+            else {
+                const char* percent = strchr(line, ',');  // Skip <bcs>
+                if (percent) {
+                    telemetry.battPercent = atoi(percent + 1);
+                    const char* voltage = strchr(percent + 1, ',');
+                    if (voltage) {
+                        telemetry.battVoltage = atoi(voltage + 1);
+                    }
+                }
+                data = "";
+                return waitResponse(1000L, data) == 1; // +CBC is the last command
+            }
+        }
+    }
+
     bool isNetworkConnected() {
         RegStatus s = getRegistrationStatus();
         return (s == REG_OK_HOME || s == REG_OK_ROAMING);
@@ -572,6 +1477,12 @@ public:
             if (isNetworkConnected()) {
                 return true;
             }
+#if GSM_ENABLE_REGISTRATION
+            if (reg_urc && reg_known) {
+                waitResponse(250, NULL, NULL); // Wait for "+CREG:" URC
+                continue;
+            }
+#endif
             delay(250);
         }
         return false;
@@ -581,28 +1492,29 @@ public:
      * GPRS functions for all external SIM CARD
      */
     bool attachGPRS(const char* apn, const char* user, const char* pwd) {
+#if GSM_ENABLE_RECONNECT
+        gprsRemember(apn, user, pwd);
+#endif
         gprsDisconnect();
 
+        CommandBatch batch;
+
         // Set the connection type to GPRS
-        sendAT(GF("+SAPBR=3,1,\"Contype\",\"GPRS\""));
-        waitResponse();
+        batch.add(GF("+SAPBR=3,1,\"Contype\",\"GPRS\""));
 
-        sendAT(GF("+SAPBR=3,1,\"APN\",\""), apn, '"');  // Set the APN
-        waitResponse();
+        batch.add(GF("+SAPBR=3,1,\"APN\",\""), apn, GF("\""));  // Set the APN
 
         if (user && strlen(user) > 0) {
-            sendAT(GF("+SAPBR=3,1,\"USER\",\""), user, '"');  // Set the user name
-            waitResponse();
+            batch.add(GF("+SAPBR=3,1,\"USER\",\""), user, GF("\""));  // Set the user name
         }
 
         if (pwd && strlen(pwd) > 0) {
-            sendAT(GF("+SAPBR=3,1,\"PWD\",\""), pwd, '"');  // Set the password
-            waitResponse();
+            batch.add(GF("+SAPBR=3,1,\"PWD\",\""), pwd, GF("\""));  // Set the password
         }
 
         // Define the PDP context
-        sendAT(GF("+CGDCONT=1,\"IP\",\""), apn, '"');
-        waitResponse();
+        batch.add(GF("+CGDCONT=1,\"IP\",\""), apn, GF("\""));
+        sendBatch(batch);
 
         // Activate the PDP context
         sendAT(GF("+CGACT=1,1"));
@@ -622,27 +1534,7 @@ public:
         if (waitResponse(60000L) != 1)
             return false;
 
-        // Set mode TCP
-        sendAT(GF("+CIPMODE=0"));
-        if (waitResponse() != 1) {
-            return false;
-        }
-
-        // Set to multiple-IP
-        sendAT(GF("+CIPMUX=1"));
-        if (waitResponse() != 1) {
-            return false;
-        }
-
-        // Put in "quick send" mode (thus no extra "Send OK")
-        sendAT(GF("+CIPQSEND=1"));
-        if (waitResponse() != 1) {
-            return false;
-        }
-
-        // Set to get data manually
-        sendAT(GF("+CIPRXGET=1"));
-        if (waitResponse() != 1) {
+        if (!setupTcpIp()) {
             return false;
         }
 
@@ -666,7 +1558,12 @@ public:
 
         // Configure Domain Name Server (DNS)
         if (dns_enabled) {
-            sendAT(GF("+CDNSCFG=\"8.8.8.8\",\"8.8.4.4\""));
+            if (dns_secondary && dns_secondary[0]) {
+                sendAT(GF("+CDNSCFG=\""), dns_primary, GF("\",\""), dns_secondary, GF("\""));
+            }
+            else {
+                sendAT(GF("+CDNSCFG=\""), dns_primary, GF("\""));
+            }
             if (waitResponse() != 1) {
                 return false;
             }
@@ -702,17 +1599,8 @@ public:
      *    activate Stream
      *    Library <-- Stream : "OK"
      *    deactivate Stream
-     *    Library -> Stream : "AT+CIPMODE=0"
-     *    note right : Set mode TCP
-     *    Library <-- Stream : "OK"
-     *    Library -> Stream : "AT+CIPMUX=1"
-     *    note right : Set to multiple-IP
-     *    Library <-- Stream : "OK"
-     *    Library -> Stream : "AT+CIPQSEND=1"
-     *    note right : Put in "quick send" mode (thus no extra "Send OK")
-     *    Library <-- Stream : "OK"
-     *    Library -> Stream : "AT+CIPRXGET=1"
-     *    note right : Set to get data manually
+     *    Library -> Stream : "AT+CIPMODE=0;+CIPMUX=1;+CIPQSEND=1;+CIPRXGET=1"
+     *    note right : Set mode TCP, multiple-IP, "quick send" mode\n(thus no extra "Send OK"), and get data manually
      *    Library <-- Stream : "OK"
      *    Library -> Stream : "AT+CSTT"
      *    note right : Default configuration for Heracles board: just AT+CSTT
@@ -724,7 +1612,7 @@ public:
      *    note right : Get Local IP Address, only assigned after connection
      *    Library <-- Stream : "OK"
      *    alt If DNS is enabled
-     *       Library -> Stream : "+CDNSCFG="8.8.8.8","8.8.4.4""
+     *       Library -> Stream : "+CDNSCFG=<primary>,<secondary>"
      *       note right : Configure Domain Name Server (DNS)
      *       Library <-- Stream : "OK"
      *    end cond
@@ -732,6 +1620,9 @@ public:
      * @enduml
      */
     bool attachGPRS() {
+#if GSM_ENABLE_RECONNECT
+        gprs_apn[0] = 0; // Attach again with the default configuration
+#endif
         gprsDisconnect();
 
         // Set the connection type to GPRS
@@ -756,27 +1647,7 @@ public:
         if (waitResponse(75000L) != 1)
             return false;
 
-        // Set mode TCP
-        sendAT(GF("+CIPMODE=0"));
-        if (waitResponse() != 1) {
-            return false;
-        }
-
-        // Set to multiple-IP
-        sendAT(GF("+CIPMUX=1"));
-        if (waitResponse() != 1) {
-            return false;
-        }
-
-        // Put in "quick send" mode (thus no extra "Send OK")
-        sendAT(GF("+CIPQSEND=1"));
-        if (waitResponse() != 1) {
-            return false;
-        }
-
-        // Set to get data manually
-        sendAT(GF("+CIPRXGET=1"));
-        if (waitResponse() != 1) {
+        if (!setupTcpIp()) {
             return false;
         }
 
@@ -800,7 +1671,12 @@ public:
 
         // Configure Domain Name Server (DNS)
         if (dns_enabled) {
-            sendAT(GF("+CDNSCFG=\"8.8.8.8\",\"8.8.4.4\""));
+            if (dns_secondary && dns_secondary[0]) {
+                sendAT(GF("+CDNSCFG=\""), dns_primary, GF("\",\""), dns_secondary, GF("\""));
+            }
+            else {
+                sendAT(GF("+CDNSCFG=\""), dns_primary, GF("\""));
+            }
             if (waitResponse() != 1) {
                 return false;
             }
@@ -851,31 +1727,162 @@ public:
     }
 
     IPAddress localIP() {
-        String strIP = getLocalIP();
-
-        int Parts[4] = { 0, };
-        int Part = 0;
-        for (uint8_t i = 0; i < strIP.length(); i++) {
-            char c = strIP[i];
-            if (c == '.') {
-                Part++;
-                if (Part > 3) {
-                    return IPAddress(0, 0, 0, 0);
-                }
+        return parseIP(getLocalIP());
+    }
+
+    /*
+     * Connect several clients concurrently: all AT+CIPSTART are sent back-to-back,
+     * then the "<mux>, CONNECT OK/FAIL" indications are collected as they arrive,
+     * so that the total time is the one of the slowest handshake.
+     * Client i connects to hosts[i]:ports[i]. Host names are handled as by GsmClient::connect():
+     * the clients whose connection by IP address failed are then connected by name, one at a time.
+     * Returns the number of connected clients.
+     */
+    uint8_t connectAll(GsmClient* const* clients, const char* const* hosts, const uint16_t* ports, uint8_t count,
+            uint32_t timeout = 75000L) {
+        connecting = 0;
+#if GSM_ENABLE_DNS_CACHE
+        uint8_t byAddress = 0;  // Mask of the clients connecting by IP address, by mux
+#endif
+        for (uint8_t i = 0; i < count; i++) {
+            GsmClient* client = clients[i];
+            client->rx.clear();
+            client->sock_connected = false;
+            client->connect_pending = false;
+
+            const char* host = hosts[i];
+#if GSM_ENABLE_RECONNECT
+            client->reconnectRemember(host, ports[i]);
+#endif
+#if GSM_ENABLE_DNS_CACHE
+            String addr;
+            if (hostAddress(host, client->ssl_enabled, addr)) {
+                host = addr.c_str();
+                byAddress |= 1 << client->mux;
+            }
+#endif
+            sendAT(GF("+CIPSSL="), client->ssl_enabled);
+            if (waitResponse() != 1 && client->ssl_enabled) {
                 continue;
             }
-            else if (c >= '0' && c <= '9') {
-                Parts[Part] *= 10;
-                Parts[Part] += c - '0';
+            sendAT(GF("+CIPSTART="), client->mux, ',', GF("\"TCP"), GF("\",\""), host, GF("\","), ports[i]);
+            client->connect_pending = true;
+            connecting++;
+            if (waitResponse() != 1 && client->connect_pending) {
+                client->connect_pending = false;
+                connecting--;
             }
-            else {
-                if (Part == 3)
+        }
+
+        String data;
+        unsigned long startMillis = millis();
+        while (connecting && millis() - startMillis < timeout) {
+            waitResponse(10, data, NULL, NULL);
+        }
+        connecting = 0;
+
+        uint8_t connected = 0;
+        for (uint8_t i = 0; i < count; i++) {
+            GsmClient* client = clients[i];
+            client->connect_pending = false;
+#if GSM_ENABLE_DNS_CACHE
+            if (!client->sock_connected && (byAddress & (1 << client->mux))) {
+                client->sock_connected = modemConnect(hosts[i], ports[i], client->mux, client->ssl_enabled);
+                if (client->sock_connected) {
+                    connectedByName(hosts[i]);
+                }
+            }
+#endif
+            client->tx_max = 0; // Queried on first send
+            client->prev_check = millis();
+            client->poll_interval = poll_min;
+            if (client->sock_connected) {
+#if GSM_ENABLE_RECONNECT
+                client->reconnect_armed = client->auto_reconnect && client->reconnect_port;
+#endif
+                connected++;
+            }
+        }
+        return connected;
+    }
+
+    /*
+     * DNS functions
+     */
+
+    // Servers configured by attachGPRS() when DNS is enabled (default: 8.8.8.8 and 8.8.4.4).
+    // The strings are not copied: they must stay valid while the modem is used (e.g. literals).
+    void setDnsServers(const char* primary, const char* secondary = NULL) {
+        dns_primary = primary ? primary : "";
+        dns_secondary = secondary;
+    }
+
+#if GSM_ENABLE_DNS_CACHE
+    /*
+     * Resolve a host name with AT+CDNSGIP. Results are kept in a small cache
+     * (GSM_DNS_CACHE_SIZE entries, least recently used first evicted) for GSM_DNS_CACHE_TTL ms.
+     * A host which could only be connected by name is connected by name until its address expires:
+     * the next resolution tries the address again.
+     */
+    bool resolveHost(const char* host, IPAddress& ip) {
+        DnsEntry* entry = dnsLookup(host);
+        if (entry) {
+            ip = IPAddress(entry->ip[0], entry->ip[1], entry->ip[2], entry->ip[3]);
+            return true;
+        }
+
+        sendAT(GF("+CDNSGIP=\""), host, GF("\""));
+        if (waitResponse(10000L) != 1) {
+            return false;
+        }
+        if (waitResponse(30000L, GF(GSM_NL "+CDNSGIP:")) != 1) {
+            return false;
+        }
+        if (stream.readStringUntil(',').toInt() != 1) {
+            streamSkipUntil('\n'); // Error code
+            return false;
+        }
+        streamSkipUntil('"');   // Skip host name
+        streamSkipUntil('"');
+        streamSkipUntil('"');
+        ip = parseIP(stream.readStringUntil('"'));
+        streamSkipUntil('\n'); // Skip optional second IP address
+        if (ip[0] == 0) {
+            return false;
+        }
+
+        // Refresh the expired entry of the host, or replace an empty, expired or else the least recently used entry
+        entry = dnsEntry(host);
+        if (!entry) {
+            entry = &dns_cache[0];
+            for (int i = 0; i < GSM_DNS_CACHE_SIZE; i++) {
+                DnsEntry* e = &dns_cache[i];
+                if (!e->valid || (millis() - e->resolved > GSM_DNS_CACHE_TTL)) {
+                    entry = e;
                     break;
+                }
+                if ((millis() - e->used) > (millis() - entry->used)) {
+                    entry = e;
+                }
             }
         }
-        return IPAddress(Parts[0], Parts[1], Parts[2], Parts[3]);
+        entry->valid = true;
+        entry->byName = false;
+        entry->hash = hostHash(host);
+        entry->resolved = millis();
+        entry->used = entry->resolved;
+        for (int i = 0; i < 4; i++) {
+            entry->ip[i] = ip[i];
+        }
+        return true;
+    }
+
+    void clearDnsCache() {
+        memset(dns_cache, 0, sizeof(dns_cache));
     }
+#endif
 
+#if GSM_ENABLE_CALL
     /*
      * Phone Call functions
      */
@@ -930,87 +1937,233 @@ public:
         sendAT(GF("+VTS="), cmd);
         return waitResponse(10000L) == 1;
     }
+#endif
 
     /*
      * Messaging functions
      */
 
+#if GSM_ENABLE_USSD
     String sendUSSD(const String& code) {
-        sendAT(GF("+CMGF=1"));
-        waitResponse();
-        sendAT(GF("+CSCS=\"HEX\""));
-        waitResponse();
+        char buf[GSM_USSD_BUFFER];
+        if (sendUSSD(code, buf, sizeof(buf)) < 0) {
+            return "";
+        }
+        return buf;
+    }
+
+    /*
+     * Send USSD code, and decode the answer in <buf> as a NUL-terminated UTF-8 string for the GSM 7 bit
+     * default alphabet and UCS2 data coding schemes, characters for 8-bit ones, hex digits for unsupported schemes.
+     * The hex answer is decoded on the fly from the modem stream, then converted in place.
+     * UCS2 and 7 bit answers may be truncated if <size> is less than 3/4 of the hex answer length.
+     * Returns the length of the decoded answer, or -1 on error.
+     */
+    int sendUSSD(const String& code, char* buf, size_t size) {
+        if (!size) {
+            return -1;
+        }
+        CommandBatch batch;
+        batch.add(GF("+CMGF=1"));
+        batch.add(GF("+CSCS=\"HEX\""));
+        sendBatch(batch);
         sendAT(GF("+CUSD=1,\""), code, GF("\""));
         if (waitResponse() != 1) {
-            return "";
+            return -1;
         }
         if (waitResponse(10000L, GF(GSM_NL "+CUSD:")) != 1) {
-            return "";
+            return -1;
         }
         stream.readStringUntil('"');
-        String hex = stream.readStringUntil('"');
+
+        // Hex digits to bytes
+        size_t len = 0;
+        int8_t high = -1;
+        char c;
+        while (stream.readBytes(&c, 1) == 1 && c != '"') {
+            int8_t v = hexNibble(c);
+            if (v < 0) {
+                continue;
+            }
+            if (high < 0) {
+                high = v;
+            }
+            else {
+                if (len < size - 1) {
+                    buf[len++] = (high << 4) | v;
+                }
+                high = -1;
+            }
+        }
         stream.readStringUntil(',');
         int dcs = stream.readStringUntil('\n').toInt();
 
-        if (dcs == 15) {
-            return gsmDecodeHex8bit(hex);
-        }
-        else if (dcs == 72) {
-            return gsmDecodeHex16bit(hex);
-        }
-        else {
-            return hex;
-        }
+        len = gsmDecodeUssd(dcs, (uint8_t*) buf, len, size - 1);
+        buf[len] = 0;
+        return len;
     }
+#endif
 
+#if GSM_ENABLE_SMS
     bool sendSMS(const String& number, const String& text) {
         sendAT(GF("+CMGF=1"));
         waitResponse();
-        sendAT(GF("+CMGS=\""), number, GF("\""));
-        if (waitResponse(GF(">")) != 1) {
-            return false;
-        }
-        stream.print(text);
-        stream.write((char) 0x1A);
-        stream.flush();
-        return waitResponse(60000L) == 1;
+        return smsSubmit(number.c_str(), text.c_str(), text.length(), false);
     }
 
     bool sendSMS_UTF16(const String& number, const void* text, size_t len) {
-        sendAT(GF("+CMGF=1"));
-        waitResponse();
-        sendAT(GF("+CSCS=\"HEX\""));
-        waitResponse();
-        sendAT(GF("+CSMP=17,167,0,8"));
-        waitResponse();
+        CommandBatch batch;
+        batch.add(GF("+CMGF=1"));
+        batch.add(GF("+CSCS=\"HEX\""));
+        batch.add(GF("+CSMP=17,167,0,8"));
+        sendBatch(batch);
 
-        sendAT(GF("+CMGS=\""), number, GF("\""));
-        if (waitResponse(GF(">")) != 1) {
-            return false;
+        return smsSubmit(number.c_str(), text, len, true);
+    }
+
+    /*
+     * Send several SMS back-to-back: text mode and character set are configured once for the whole batch.
+     * Returns the number of SMS successfully sent.
+     */
+    size_t sendSMSBatch(const GsmSms* messages, size_t count, bool utf16 = false) {
+        CommandBatch batch;
+        batch.add(GF("+CMGF=1"));
+        if (utf16) {
+            batch.add(GF("+CSCS=\"HEX\""));
+            batch.add(GF("+CSMP=17,167,0,8"));
+        }
+        else {
+            batch.add(GF("+CSCS=\"GSM\""));
+            batch.add(GF("+CSMP=17,167,0,0"));
+        }
+        if (!sendBatch(batch)) {
+            return 0;
         }
 
-        uint16_t* t = (uint16_t*) text;
-        for (size_t i = 0; i < len; i++) {
-            uint8_t c = t[i] >> 8;
-            if (c < 0x10) {
-                stream.print('0');
+        size_t sent = 0;
+        for (size_t i = 0; i < count; i++) {
+            size_t len = messages[i].len;
+            if (!len && !utf16) {
+                len = strlen((const char*) messages[i].text);
             }
-            stream.print(c, HEX);
-            c = t[i] & 0xFF;
-            if (c < 0x10) {
-                stream.print('0');
+            if (smsSubmit(messages[i].number, messages[i].text, len, utf16)) {
+                sent++;
             }
-            stream.print(c, HEX);
         }
-        stream.write((char) 0x1A);
-        stream.flush();
-        return waitResponse(60000L) == 1;
+        return sent;
+    }
+
+    /*
+     * Enable "+CMTI:" indications of SMS received and stored by the modem, see readSMS().
+     */
+    bool enableSMSReceive() {
+        CommandBatch batch;
+        batch.add(GF("+CMGF=1"));
+        batch.add(GF("+CNMI=2,1"));
+        return sendBatch(batch);
+    }
+
+    // Number of received SMS indicated by the modem and not yet read
+    size_t availableSMS() {
+        handleUrc();
+        return sms_queue.size();
+    }
+
+    /*
+     * Read the oldest received SMS with AT+CMGR, parsing its header in <info> and its text in <text>
+     * (NUL-terminated, truncated to <size> - 1 characters) as it is received, then delete it
+     * from the modem storage unless <remove> is false.
+     * Returns the text length, or -1 if no SMS is available.
+     */
+    int readSMS(GsmSmsInfo& info, char* text, size_t size, bool remove = true) {
+        uint8_t index;
+        handleUrc();
+        while (sms_queue.get(&index)) {
+            int len = readSMS(index, info, text, size);
+            if (len < 0) {
+                continue; // Empty or already read storage index
+            }
+            if (remove) {
+                sendAT(GF("+CMGD="), index);
+                waitResponse();
+            }
+            return len;
+        }
+        return -1;
+    }
+
+    // Read the SMS at storage <index> (text mode, set by enableSMSReceive())
+    int readSMS(uint8_t index, GsmSmsInfo& info, char* text, size_t size) {
+        sendAT(GF("+CMGR="), index);
+        if (waitResponse(5000L, GF(GSM_NL "+CMGR:"), GFP(GSM_OK), GFP(GSM_ERROR)) != 1) {
+            return -1;
+        }
+        info.index = index;
+        info.sender[0] = 0;
+        info.timestamp[0] = 0;
+
+        // Header: <stat>,<oa>[,<alpha>],<scts> with quoted fields
+        char c;
+        bool quoted = false;
+        uint8_t field = 0;
+        size_t pos = 0;
+        while (stream.readBytes(&c, 1) == 1 && c != '\n') {
+            if (c == '"') {
+                quoted = !quoted;
+                if (quoted) {
+                    field++;
+                    pos = 0;
+                }
+                continue;
+            }
+            if (!quoted) {
+                continue;
+            }
+            char* dst = (field == 2) ? info.sender : info.timestamp;
+            size_t dstSize = (field == 2) ? sizeof(info.sender) : sizeof(info.timestamp);
+            if (field >= 2 && pos < dstSize - 1) {
+                dst[pos++] = c;
+                dst[pos] = 0;
+            }
+        }
+
+        // Text, up to the final "<CR><LF><CR><LF>OK<CR><LF>"
+        static const char end[] = GSM_NL GSM_NL "OK" GSM_NL;
+        const size_t endLen = sizeof(end) - 1;
+        char tail[sizeof(end) - 1];
+        size_t count = 0;
+        while (stream.readBytes(&c, 1) == 1) {
+            if (count < size - 1) {
+                text[count] = c;
+            }
+            memmove(tail, tail + 1, endLen - 1);
+            tail[endLen - 1] = c;
+            count++;
+            if (count >= endLen && !memcmp(tail, end, endLen)) {
+                break;
+            }
+        }
+        count = (count >= endLen) ? count - endLen : 0;
+        if (count > size - 1) {
+            count = size - 1;
+        }
+        text[count] = 0;
+        return count;
     }
+#endif
 
+#if GSM_ENABLE_LOCATION
     /*
      * Location functions
      */
 
+#if GSM_ENABLE_QUEUE
+    // Queued version of getGsmLocation(), which doesn't hold socket data back
+    bool requestGsmLocation(GsmResponseCallback callback) {
+        return queueCommand(GSM_PRIO_MANAGEMENT, GF("+CIPGSMLOC=1,1"), GF(GSM_NL "+CIPGSMLOC:"), callback, 10000L);
+    }
+#endif
+
     String getGsmLocation() {
         sendAT(GF("+CIPGSMLOC=1,1"));
         if (waitResponse(10000L, GF(GSM_NL "+CIPGSMLOC:")) != 1) {
@@ -1021,7 +2174,9 @@ public:
         res.trim();
         return res;
     }
+#endif
 
+#if GSM_ENABLE_BATTERY
     /*
      * Battery functions
      */
@@ -1050,9 +2205,295 @@ public:
         waitResponse();
         return res;
     }
+#endif
+
+#if GSM_ENABLE_TIME
+    /*
+     * Network time functions
+     */
+
+    /*
+     * Enable network time (NITZ) updates: the modem clock is set by the network at registration,
+     * and the "*PSUTTZ:"/"+CTZV:" indications are captured by the response dispatcher.
+     * The current modem clock is read once with syncNetworkTime().
+     */
+    bool enableNetworkTime(bool enable = true) {
+        sendAT(GF("+CLTS="), enable);
+        if (waitResponse() != 1) {
+            return false;
+        }
+        return !enable || syncNetworkTime();
+    }
+
+    // Read the modem clock with AT+CCLK? (false if it was not set by the network)
+    bool syncNetworkTime() {
+        sendAT(GF("+CCLK?"));
+        if (waitResponse(GF(GSM_NL "+CCLK:")) != 1) {
+            return false;
+        }
+        char line[32];
+        streamReadLine(line, sizeof(line));
+        waitResponse();
+        return updateNetworkTime(line, false);
+    }
+
+    /*
+     * UTC time (seconds since 1970-01-01) of the last network time update, advanced with millis():
+     * no command is sent to the modem. Returns 0 if the time is unknown.
+     */
+    uint32_t getNetworkTime() {
+        if (!time_epoch) {
+            return 0;
+        }
+        uint32_t elapsed = (millis() - time_millis) / 1000;
+        if (elapsed > 86400L) {
+            // Move the reference forward, before millis() wraps
+            time_epoch += elapsed;
+            time_millis += elapsed * 1000;
+            elapsed = 0;
+        }
+        return time_epoch + elapsed;
+    }
+
+    // Local time zone of the network, in quarters of an hour
+    int8_t getTimeZone() {
+        return time_zone;
+    }
+#endif
+
+#if GSM_ENABLE_HTTP
+    /*
+     * HTTP functions, using the HTTP stack of the modem over the bearer opened by attachGPRS().
+     * httpGet()/httpPost() return the HTTP status code (0 on failure) and the body length,
+     * then the body is read with httpRead() until httpEnd():
+     *
+     *    uint32_t length;
+     *    if (modem.httpGet("http://example.com/data", &length) == 200) {
+     *        for (uint32_t offset = 0; offset < length;) {
+     *            size_t n = modem.httpRead(buf, sizeof(buf), offset);
+     *            if (!n) break;
+     *            offset += n;
+     *        }
+     *    }
+     *    modem.httpEnd();
+     */
+
+    int httpGet(const char* url, uint32_t* length = NULL, bool ssl = false, uint32_t timeout = 60000L) {
+        if (!httpBegin(url, ssl)) {
+            return 0;
+        }
+        return httpAction(0, length, timeout);
+    }
+
+    int httpPost(const char* url, const char* contentType, const void* body, size_t len, uint32_t* length = NULL,
+            bool ssl = false, uint32_t timeout = 60000L) {
+        if (!httpBegin(url, ssl)) {
+            return 0;
+        }
+        sendAT(GF("+HTTPPARA=\"CONTENT\",\""), contentType, GF("\""));
+        if (waitResponse() != 1) {
+            return 0;
+        }
+        sendAT(GF("+HTTPDATA="), len, ',', 10000);
+        if (waitResponse(GF("DOWNLOAD")) != 1) {
+            return 0;
+        }
+        stream.write((const uint8_t*) body, len);
+        stream.flush();
+        if (waitResponse(10000L) != 1) {
+            return 0;
+        }
+        return httpAction(1, length, timeout);
+    }
+
+    /*
+     * Read up to <size> bytes of the response body from <offset> directly into <buf>.
+     * Returns the number of bytes read, 0 at the end of the body.
+     */
+    size_t httpRead(void* buf, size_t size, uint32_t offset) {
+        sendAT(GF("+HTTPREAD="), offset, ',', size);
+        if (waitResponse(10000L, GF(GSM_NL "+HTTPREAD:"), GFP(GSM_OK), GFP(GSM_ERROR)) != 1) {
+            return 0;
+        }
+        size_t len = stream.readStringUntil('\n').toInt();
+        if (len > size) {
+            len = size;
+        }
+        len = stream.readBytes((uint8_t*) buf, len);
+        waitResponse();
+        return len;
+    }
+
+    bool httpEnd() {
+        sendAT(GF("+HTTPTERM"));
+        return waitResponse() == 1;
+    }
+#endif
+
+#if GSM_ENABLE_DUTY_CYCLE
+    /*
+     * Duty cycling: data written to the clients is buffered, and sent by maintain() every <period> ms
+     * or as soon as <threshold> bytes are buffered (period 0 sends writes immediately, as by default).
+     * With a DTR hook, the modem sleeps (AT+CSCLK=1, DTR high) when maintain() finds nothing to do:
+     * it is woken up (DTR low for GSM_WAKE_DELAY ms) before the next command, and idle sockets are not
+     * polled while it sleeps, incoming data being signalled by "+CIPRXGET: 1".
+     */
+    void setDutyCycle(uint32_t period, uint16_t threshold = GSM_TX_BATCH_BUFFER, GsmDtrCallback dtr = NULL) {
+        if (modem_sleeping) {
+            modemWake();
+        }
+        if (!period || !dtr) {
+            flushBatches();
+            if (sleep_enabled) {
+                sendAT(GF("+CSCLK=0"));
+                sleep_enabled = waitResponse() != 1;
+            }
+        }
+        duty_period = period;
+        duty_threshold = threshold;
+        duty_last = millis();
+        dtr_hook = dtr;
+        wake_start = millis();
+    }
+
+    // Send the data buffered by all clients now
+    bool flushBatches() {
+        bool ok = true;
+        for (int mux = 0; mux < GSM_MUX_COUNT; mux++) {
+            if (sockets[mux] && !flushBatch(sockets[mux])) {
+                ok = false;
+            }
+        }
+        duty_last = millis();
+        return ok;
+    }
+
+    bool isSleeping() {
+        return modem_sleeping;
+    }
+
+    GsmEnergyStats getEnergyStats() {
+        GsmEnergyStats stats = energy_stats;
+        if (!modem_sleeping) {
+            stats.awakeTime += millis() - wake_start;
+        }
+        return stats;
+    }
+#endif
+
+#if GSM_ENABLE_TRACE
+    /*
+     * Record trace events in <buffer>, used as a ring of <size> events (NULL stops tracing).
+     * Event n (counted from 0) is stored in buffer[n % size]: the last one is at (getTraceCount() - 1) % size.
+     */
+    void setTraceBuffer(GsmTraceEvent* buffer, uint16_t size) {
+        trace_buf = size ? buffer : NULL;
+        trace_size = size;
+        trace_head = 0;
+        trace_count = 0;
+    }
+
+    uint32_t getTraceCount() {
+        return trace_count;
+    }
+
+    /*
+     * Identifier of a command in the trace: 16 bits FNV-1a hash of the first part of the command line
+     * given to sendAT(), e.g. commandId("+CIPSEND=") for AT+CIPSEND=<mux>,<length>.
+     */
+    static uint16_t commandId(GsmConstStr cmd) {
+        uint32_t hash = 2166136261UL;
+        for (size_t i = 0; gsmStrChar(cmd, i); i++) {
+            hash = (hash ^ (uint8_t) gsmStrChar(cmd, i)) * 16777619UL;
+        }
+        return (uint16_t) (hash ^ (hash >> 16));
+    }
+
+    template<typename T>
+    static uint16_t commandId(T) {
+        return 0; // Command not given as a constant string
+    }
+
+    void trace(uint8_t type, uint8_t mux, uint16_t value) {
+        if (!trace_buf) {
+            return;
+        }
+        GsmTraceEvent& e = trace_buf[trace_head];
+        e.time = micros();
+        e.type = type;
+        e.mux = mux;
+        e.value = value;
+        if (++trace_head == trace_size) {
+            trace_head = 0;
+        }
+        trace_count++;
+    }
+#endif
 
 protected:
 
+    /*
+     * TCP/IP application settings, common to both attachGPRS() flavours
+     */
+    bool setupTcpIp() {
+        CommandBatch batch;
+        batch.add(GF("+CIPMODE=0"));    // Set mode TCP
+        batch.add(GF("+CIPMUX=1"));     // Set to multiple-IP
+        batch.add(GF("+CIPQSEND=1"));   // Put in "quick send" mode (thus no extra "Send OK")
+        batch.add(GF("+CIPRXGET=1"));   // Set to get data manually
+        return sendBatch(batch);
+    }
+
+    /*
+     * Connect using the cached IP address of <host> when possible,
+     * and fall back on <host> if the connection by IP address fails (e.g. virtual host behind a proxy):
+     * if the connection by name succeeds, <host> is used until its address expires.
+     */
+    bool modemConnectHost(const char* host, uint16_t port, uint8_t mux, bool sslEnabled) {
+#if GSM_ENABLE_DNS_CACHE
+        String addr;
+        if (hostAddress(host, sslEnabled, addr)) {
+            if (modemConnect(addr.c_str(), port, mux, sslEnabled)) {
+                return true;
+            }
+            if (!modemConnect(host, port, mux, sslEnabled)) {
+                return false; // Not a matter of address (e.g. network outage)
+            }
+            connectedByName(host);
+            return true;
+        }
+#endif
+        return modemConnect(host, port, mux, sslEnabled);
+    }
+
+#if GSM_ENABLE_DNS_CACHE
+    /*
+     * Get in <addr> the IP address to connect to <host> by, cached or resolved. Returns false if <host> must be
+     * connected by name: SSL connections (the handshake needs the name), IP addresses, unresolved hosts,
+     * and hosts which could only be connected by name while their address is valid.
+     */
+    bool hostAddress(const char* host, bool sslEnabled, String& addr) {
+        if (sslEnabled || isIpAddress(host)) {
+            return false;
+        }
+        DnsEntry* entry = dnsLookup(host);
+        IPAddress ip;
+        if ((entry && entry->byName) || !resolveHost(host, ip)) {
+            return false;
+        }
+        addr = ipToString(ip);
+        return true;
+    }
+
+    // The connection to <host> by IP address failed and the one by name succeeded
+    void connectedByName(const char* host) {
+        DnsEntry* entry = dnsEntry(host);
+        if (entry) {
+            entry->byName = true;
+        }
+    }
+#endif
+
     bool modemConnect(const char* host, uint16_t port, uint8_t mux, bool sslEnabled) {
         sendAT(GF("+CIPSSL="), sslEnabled);
         int rsp = waitResponse();
@@ -1071,36 +2512,234 @@ protected:
     }
 
     int modemSend(const void* buff, size_t len, uint8_t mux) {
-        sendAT(GF("+CIPSEND="), mux, ',', len);
-        if (waitResponse(GF(">")) != 1) {
-            return 0;
+        GsmSegment segment = { buff, len };
+        return modemSendv(&segment, 1, mux);
+    }
+
+    /*
+     * Send the segments as back-to-back AT+CIPSEND transactions of the connection maximum size,
+     * each transaction possibly spanning several segments.
+     * Returns the number of bytes accepted by the modem (stops at the first partial transaction).
+     */
+    size_t modemSendv(const GsmSegment* segments, uint8_t count, uint8_t mux) {
+        size_t total = 0;
+        for (uint8_t i = 0; i < count; i++) {
+            total += segments[i].len;
+        }
+        size_t maxChunk = modemGetMaxSend(mux);
+
+        size_t sent = 0;
+        uint8_t seg = 0;
+        size_t offset = 0;
+        while (sent < total) {
+            size_t chunk = total - sent;
+            if (chunk > maxChunk) {
+                chunk = maxChunk;
+            }
+            sendAT(GF("+CIPSEND="), mux, ',', chunk);
+            if (waitResponse(GF(">")) != 1) {
+                break;
+            }
+            for (size_t left = chunk; left > 0;) {
+                size_t n = segments[seg].len - offset;
+                if (n > left) {
+                    n = left;
+                }
+                stream.write((const uint8_t*) segments[seg].data + offset, n);
+                offset += n;
+                left -= n;
+                if (offset == segments[seg].len) {
+                    seg++;
+                    offset = 0;
+                }
+            }
+            stream.flush();
+            if (waitResponse(GF(GSM_NL "DATA ACCEPT:")) != 1) {
+                break;
+            }
+            streamSkipUntil(','); // Skip mux
+            size_t accepted = stream.readStringUntil('\n').toInt();
+            sent += accepted;
+            if (accepted != chunk) {
+                break;
+            }
         }
-        stream.write((uint8_t*) buff, len);
-        stream.flush();
-        if (waitResponse(GF(GSM_NL "DATA ACCEPT:")) != 1) {
-            return 0;
+        GSM_STATS(traffic_stats.bytesSent += sent);
+        GSM_TRACE(this, GSM_TRACE_SEND, mux, sent);
+        if (sent && sockets[mux]) {
+            sockets[mux]->poll_interval = poll_min; // Answer expected soon
         }
-        streamSkipUntil(','); // Skip mux
-        return stream.readStringUntil('\n').toInt();
+        return sent;
+    }
+
+    /*
+     * Send <len> bytes from <src> as back-to-back AT+CIPSEND transactions, double buffered:
+     * while one buffer is written to the modem stream, the other one is filled from <src>,
+     * and the next buffer is read before waiting for "DATA ACCEPT".
+     * If <src> runs dry in the middle of a transaction, the transaction is cancelled with ESC
+     * (nothing of it is sent) and the upload stops.
+     * Returns the number of bytes accepted by the modem, not counting the cancelled transaction.
+     */
+    size_t modemSendFrom(Stream& src, size_t len, uint8_t mux, GsmProgressCallback progress, GsmTransferStats* stats) {
+        uint8_t buf[2][GSM_UPLOAD_BUFFER];
+        size_t fill[2] = { 0, 0 };
+        uint8_t cur = 0;
+        size_t pos = 0;         // Position in the current buffer
+        size_t fetched = 0;     // Bytes read from <src>
+        size_t sent = 0;
+        bool dry = false;
+        uint32_t start = millis();
+        size_t maxChunk = modemGetMaxSend(mux);
+
+        fill[cur] = src.readBytes(buf[cur], (len < GSM_UPLOAD_BUFFER) ? len : GSM_UPLOAD_BUFFER);
+        fetched = fill[cur];
+
+        while (sent < len && fill[cur] > pos) {
+            size_t chunk = len - sent;
+            if (chunk > maxChunk) {
+                chunk = maxChunk;
+            }
+            sendAT(GF("+CIPSEND="), mux, ',', chunk);
+            if (waitResponse(GF(">")) != 1) {
+                break;
+            }
+            for (size_t left = chunk; left > 0;) {
+                if (!fill[cur]) {
+                    dry = true; // Nothing more from <src>
+                    break;
+                }
+                size_t n = fill[cur] - pos;
+                if (n > left) {
+                    n = left;
+                }
+                stream.write(buf[cur] + pos, n);
+                pos += n;
+                left -= n;
+
+                // Prefetch in the other buffer while the UART sends this one
+                uint8_t other = cur ^ 1;
+                if (!fill[other] && fetched < len) {
+                    size_t want = len - fetched;
+                    if (want > GSM_UPLOAD_BUFFER) {
+                        want = GSM_UPLOAD_BUFFER;
+                    }
+                    fill[other] = src.readBytes(buf[other], want);
+                    fetched += fill[other];
+                }
+                if (pos == fill[cur]) {
+                    // Current buffer sent: free it for the next prefetch, and continue with the other one
+                    fill[cur] = 0;
+                    pos = 0;
+                    cur ^= 1;
+                }
+            }
+            if (dry) {
+                // Cancel the transaction, so that the modem leaves data mode without sending it
+                stream.write((uint8_t) 0x1B);
+                stream.flush();
+                waitResponse(GFP(GSM_OK), GFP(GSM_ERROR), GF("SEND FAIL" GSM_NL));
+                break;
+            }
+            stream.flush();
+            if (waitResponse(GF(GSM_NL "DATA ACCEPT:")) != 1) {
+                break;
+            }
+            streamSkipUntil(','); // Skip mux
+            size_t accepted = stream.readStringUntil('\n').toInt();
+            sent += accepted;
+            if (progress) {
+                progress(sent, len);
+            }
+            if (accepted != chunk) {
+                break;
+            }
+        }
+
+        if (stats) {
+            stats->bytes = sent;
+            stats->elapsed = millis() - start;
+            stats->throughput = stats->elapsed ? (uint32_t) ((uint64_t) sent * 1000 / stats->elapsed) : 0;
+        }
+        GSM_STATS(traffic_stats.bytesSent += sent);
+        GSM_TRACE(this, GSM_TRACE_SEND, mux, sent);
+        if (sent && sockets[mux]) {
+            sockets[mux]->poll_interval = poll_min; // Answer expected soon
+        }
+        return sent;
+    }
+
+    /*
+     * Maximum data length of one AT+CIPSEND on the connection, queried once per connection
+     * with AT+CIPSEND? (one "+CIPSEND: <mux>,<size>" line per connection).
+     */
+    size_t modemGetMaxSend(uint8_t mux) {
+        GsmClient* sock = sockets[mux];
+        if (sock && sock->tx_max) {
+            return sock->tx_max;
+        }
+        sendAT(GF("+CIPSEND?"));
+        while (waitResponse(GF(GSM_NL "+CIPSEND:"), GFP(GSM_OK), GFP(GSM_ERROR)) == 1) {
+            int n = stream.readStringUntil(',').toInt();
+            int size = stream.readStringUntil('\n').toInt();
+            if (n >= 0 && n < GSM_MUX_COUNT && sockets[n] && sockets[n]->sock_connected) {
+                sockets[n]->tx_max = size;
+            }
+        }
+        if (sock && sock->tx_max) {
+            return sock->tx_max;
+        }
+        return GSM_TX_MAX_CHUNK;
     }
 
-    size_t modemRead(size_t size, uint8_t mux) {
+    /*
+     * Get up to <size> bytes of data from the network.
+     * The first <bufSize> bytes are copied directly to <buf>, the remaining ones are
+     * stored in the rx fifo of the socket. When <buf> is NULL, all data goes to the rx fifo.
+     * Returns the number of bytes received from the modem.
+     */
+    size_t modemRead(size_t size, uint8_t mux, uint8_t* buf = NULL, size_t bufSize = 0) {
+        GsmClient* sock = sockets[mux];
+        if (!buf) {
+            bufSize = 0;
+        }
+        if (size < (size_t) sock->rx.free()) {
+            size = sock->rx.free(); // Read ahead to fill the rx fifo
+        }
+        if (size > GSM_RX_MAX_CHUNK) {
+            size = GSM_RX_MAX_CHUNK;
+        }
         sendAT(GF("+CIPRXGET=2,"), mux, ',', size);
-        if (waitResponse(GF("+CIPRXGET:")) != 1) {
+        if (waitResponse(GF("+CIPRXGET: 2,")) != 1) { // Not "+CIPRXGET: 1,<mux>" of another socket
             return 0;
         }
 
-        streamSkipUntil(','); // Skip mode 2
         streamSkipUntil(','); // Skip mux
         size_t len = stream.readStringUntil(',').toInt();
-        sockets[mux]->sock_available = stream.readStringUntil('\n').toInt();
-
-        for (size_t i = 0; i < len; i++) {
+        sock->sock_available = stream.readStringUntil('\n').toInt();
+        sock->prev_check = millis(); // Pending length is up to date
+        sock->poll_interval = poll_min;
+        GSM_STATS(traffic_stats.bytesReceived += len);
+        GSM_TRACE(this, GSM_TRACE_READ, mux, len);
+
+        size_t direct = (len < bufSize) ? len : bufSize;
+        size_t i = 0;
+        while (i < direct) {
+            int avail = stream.available();
+            if (avail <= 0) {
+                GSM_YIELD();
+                continue;
+            }
+            if ((size_t) avail > direct - i) {
+                avail = direct - i;
+            }
+            i += stream.readBytes(buf + i, avail);
+        }
+        for (; i < len; i++) {
             while (!stream.available()) {
                 GSM_YIELD();
             }
             char c = stream.read();
-            sockets[mux]->rx.put(c);
+            sock->rx.put(c);
         }
         waitResponse();
         return len;
@@ -1109,15 +2748,11 @@ protected:
     size_t modemGetAvailable(uint8_t mux) {
         sendAT(GF("+CIPRXGET=4,"), mux);
         size_t result = 0;
-        if (waitResponse(GF("+CIPRXGET:")) == 1) {
-            streamSkipUntil(','); // Skip mode 4
+        if (waitResponse(GF("+CIPRXGET: 4,")) == 1) {
             streamSkipUntil(','); // Skip mux
             result = stream.readStringUntil('\n').toInt();
             waitResponse();
         }
-        if (!result) {
-            sockets[mux]->sock_connected = modemGetConnected(mux);
-        }
         return result;
     }
 
@@ -1128,6 +2763,77 @@ protected:
         return 1 == res;
     }
 
+    /*
+     * Update the connection state of all sockets with a single AT+CIPSTATUS.
+     * In multi-IP mode, the modem answers "OK", "STATE: <state>",
+     * then one line "C: <n>,<bearer>,<type>,<ip>,<port>,<state>" per connection, up to "C: 5".
+     * The table is read line by line, as its rows are separated by a single end of line.
+     */
+    bool modemGetConnectedAll() {
+        sendAT(GF("+CIPSTATUS"));
+        if (waitResponse() != 1) {
+            return false;
+        }
+        unsigned long startMillis = millis();
+        while (millis() - startMillis < 1000) {
+            char line[80];
+            if (!streamReadLine(line, sizeof(line))) {
+                continue; // Empty line, or nothing received yet
+            }
+            if (strncmp(line, "+CIPRXGET: 1,", 13) == 0) {
+                int mux = atoi(line + 13);
+                if (mux >= 0 && mux < GSM_MUX_COUNT && sockets[mux]) {
+                    sockets[mux]->poll_interval = 0; // Data received while reading the table
+                }
+                continue;
+            }
+            if (strncmp(line, "C:", 2) != 0) {
+                continue; // "STATE: <state>"
+            }
+            int mux = updateConnectionState(line + 2);
+            if (mux >= GSM_STATUS_ENTRIES - 1) {
+                return true; // Last entry of the table
+            }
+        }
+        return false;
+    }
+
+    // Update the socket state from a row "<n>,<bearer>,<type>,<ip>,<port>,<state>" of the status table. Returns <n>.
+    int updateConnectionState(const char* row) {
+        int mux = atoi(row);
+        if (mux >= 0 && mux < GSM_MUX_COUNT && sockets[mux]) {
+            bool connected = (strstr(row, "\"CONNECTED\"") != NULL);
+            if (connected != sockets[mux]->sock_connected) {
+                GSM_TRACE(this, GSM_TRACE_STATE, mux, connected);
+            }
+            sockets[mux]->sock_connected = connected;
+        }
+        return mux;
+    }
+
+    /*
+     * Refresh the state of all connections. With the command queue, AT+CIPSTATUS is queued
+     * as socket control and its table is handled by the response dispatcher, instead of being waited for.
+     */
+    void refreshStatus() {
+#if GSM_ENABLE_QUEUE
+        if (cmd_inflight.cmd == GFP(GSM_STATUS)) {
+            return;
+        }
+        for (int i = 0; i < GSM_QUEUE_SIZE; i++) {
+            if (cmd_queue[i].cmd == GFP(GSM_STATUS)) {
+                return;
+            }
+        }
+        if (queueCommand(GSM_PRIO_CONTROL, GFP(GSM_STATUS), NULL, NULL)) {
+            GSM_STATS(poll_stats.statusQueries++);
+            return;
+        }
+#endif
+        modemGetConnectedAll();
+        GSM_STATS(poll_stats.statusQueries++);
+    }
+
 public:
 
     /* Utilities */
@@ -1143,8 +2849,18 @@ public:
         streamWrite(tail...);
     }
 
-    bool streamSkipUntil(char c) { // TODO: timeout
-        while (true) {
+    // Read the rest of the current line (without end of line) in <buf>, truncated to <size> - 1 characters
+    size_t streamReadLine(char* buf, size_t size) {
+        size_t len = stream.readBytesUntil('\n', buf, size - 1);
+        if (len && buf[len - 1] == '\r') {
+            len--;
+        }
+        buf[len] = 0;
+        return len;
+    }
+
+    bool streamSkipUntil(char c) { // TODO: timeout
+        while (true) {
             while (!stream.available()) {
                 GSM_YIELD();
             }
@@ -1154,13 +2870,87 @@ public:
         return false;
     }
 
-    template<typename ... Args>
-    void sendAT(Args ... cmd) {
-        streamWrite("AT", cmd..., GSM_NL);
+    template<typename T, typename ... Args>
+    void sendAT(T cmd, Args ... args) {
+#if GSM_ENABLE_QUEUE
+        waitCommandInFlight();
+#endif
+#if GSM_ENABLE_DUTY_CYCLE
+        if (modem_sleeping) {
+            modemWake();
+        }
+#endif
+        GSM_STATS(traffic_stats.commands++);
+        GSM_TRACE(this, GSM_TRACE_COMMAND, 0xFF, commandId(cmd));
+        streamWrite("AT", cmd, args..., GSM_NL);
         stream.flush();
         GSM_YIELD();
     }
 
+    /*
+     * Send the commands of the batch chained on AT command lines of at most GSM_AT_LINE_MAX characters.
+     * If a line fails, its commands are sent again one by one to find the failing one
+     * (see CommandBatch::failedIndex()).
+     * Returns true if all commands succeeded.
+     */
+    bool sendBatch(CommandBatch& batch, uint32_t timeout = 1000L) {
+#if GSM_ENABLE_QUEUE
+        waitCommandInFlight();
+#endif
+#if GSM_ENABLE_DUTY_CYCLE
+        if (modem_sleeping) {
+            modemWake();
+        }
+#endif
+        batch.failed = -1;
+        uint8_t first = 0;
+        while (first < batch.count) {
+            // Find the commands fitting on one line
+            size_t len = 2 + batch.length(first); // "AT"
+            uint8_t last = first + 1;
+            while (last < batch.count) {
+                size_t next = batch.length(last) + (batch.isExtended(last - 1) ? 1 : 0);
+                if (len + next > GSM_AT_LINE_MAX) {
+                    break;
+                }
+                len += next;
+                last++;
+            }
+
+            GSM_STATS(traffic_stats.commands++);
+            GSM_TRACE(this, GSM_TRACE_COMMAND, 0xFF, commandId(batch.cmds[first].prefix));
+            stream.print(GF("AT"));
+            for (uint8_t i = first; i < last; i++) {
+                if (i > first && batch.isExtended(i - 1)) {
+                    stream.print(';');
+                }
+                sendBatchCommand(batch, i);
+            }
+            stream.print(GF(GSM_NL));
+            stream.flush();
+            GSM_YIELD();
+
+            if (waitResponse(timeout) != 1) {
+                // Fall back to individual commands to pinpoint the failing one
+                for (uint8_t i = first; i < last; i++) {
+                    GSM_STATS(traffic_stats.commands++);
+                    GSM_TRACE(this, GSM_TRACE_COMMAND, 0xFF, commandId(batch.cmds[i].prefix));
+                    stream.print(GF("AT"));
+                    sendBatchCommand(batch, i);
+                    stream.print(GF(GSM_NL));
+                    stream.flush();
+                    GSM_YIELD();
+                    if (waitResponse(timeout) != 1) {
+                        batch.failed = i;
+                        return false;
+                    }
+                }
+            }
+            first = last;
+        }
+        return true;
+    }
+
     uint8_t waitResponse(uint32_t timeout, String& data, GsmConstStr r1 = GFP(GSM_OK), GsmConstStr r2 = GFP(GSM_ERROR),
             GsmConstStr r3 = NULL, GsmConstStr r4 = NULL, GsmConstStr r5 = NULL)
     {
@@ -1175,47 +2965,107 @@ public:
                     continue; // Skip 0x00 bytes, just in case
                 }
                 data += (char) a;
+                if (connecting && handleConnectResult(data)) {
+                    continue; // Checked first, as "CONNECT OK" would match GSM_OK
+                }
+#if GSM_ENABLE_QUEUE
+                if (cmd_inflight.cmd && inflight_state < INFLIGHT_OK && handleInflight(data)) {
+                    continue; // Checked first, as its final result would match GSM_OK or GSM_ERROR
+                }
+#endif
                 if (r1 && data.endsWith(r1)) {
+                    GSM_TRACE(this, GSM_TRACE_RESPONSE, 0xFF, 1);
                     return 1;
                 }
                 else if (r2 && data.endsWith(r2)) {
+                    GSM_TRACE(this, GSM_TRACE_RESPONSE, 0xFF, 2);
                     return 2;
                 }
                 else if (r3 && data.endsWith(r3)) {
+                    GSM_TRACE(this, GSM_TRACE_RESPONSE, 0xFF, 3);
                     return 3;
                 }
                 else if (r4 && data.endsWith(r4)) {
+                    GSM_TRACE(this, GSM_TRACE_RESPONSE, 0xFF, 4);
                     return 4;
                 }
                 else if (r5 && data.endsWith(r5)) {
+                    GSM_TRACE(this, GSM_TRACE_RESPONSE, 0xFF, 5);
                     return 5;
                 }
-                else if (data.endsWith(GF(GSM_NL "+CIPRXGET:"))) {
-                    String mode = stream.readStringUntil(',');
-                    if (mode.toInt() == 1) {
-                        int mux = stream.readStringUntil('\n').toInt();
-                        if (mux >= 0 && mux < GSM_MUX_COUNT && sockets[mux]) {
-                            prev_check = 0;
-                        }
-                        data = "";
+                else if (data.endsWith(GF(GSM_NL "+CIPRXGET: 1,"))) {
+                    int mux = stream.readStringUntil('\n').toInt();
+                    if (mux >= 0 && mux < GSM_MUX_COUNT && sockets[mux]) {
+                        sockets[mux]->poll_interval = 0; // Poll this socket on next maintain()
+                        GSM_STATS(poll_stats.wakeups++);
                     }
-                    else {
-                        data += mode;
+                    GSM_TRACE(this, GSM_TRACE_URC, mux, GSM_URC_DATA);
+                    data = "";
+                }
+#if GSM_ENABLE_SMS
+                else if (data.endsWith(GF(GSM_NL "+CMTI:"))) {
+                    streamSkipUntil(','); // Skip storage
+                    sms_queue.put(stream.readStringUntil('\n').toInt());
+                    GSM_TRACE(this, GSM_TRACE_URC, 0xFF, GSM_URC_SMS);
+                    data = "";
+                }
+#endif
+#if GSM_ENABLE_TIME
+                else if (data.endsWith(GF(GSM_NL "*PSUTTZ:"))) {
+                    char line[48];
+                    streamReadLine(line, sizeof(line));
+                    updateNetworkTime(line, true);
+                    GSM_TRACE(this, GSM_TRACE_URC, 0xFF, GSM_URC_TIME);
+                    data = "";
+                }
+                else if (data.endsWith(GF(GSM_NL "+CTZV:"))) {
+                    time_zone = stream.readStringUntil('\n').toInt();
+                    GSM_TRACE(this, GSM_TRACE_URC, 0xFF, GSM_URC_TIME);
+                    data = "";
+                }
+#endif
+#if GSM_ENABLE_REGISTRATION
+                else if (data.endsWith(GF(GSM_NL "+CREG:"))) {
+                    String line = stream.readStringUntil('\n');
+                    updateRegistration(false, line.c_str());
+                    GSM_TRACE(this, GSM_TRACE_URC, 0xFF, GSM_URC_REG);
+                    data = "";
+                }
+                else if (data.endsWith(GF(GSM_NL "+CGREG:"))) {
+                    String line = stream.readStringUntil('\n');
+                    updateRegistration(true, line.c_str());
+                    GSM_TRACE(this, GSM_TRACE_URC, 0xFF, GSM_URC_GPRS_REG);
+                    data = "";
+                }
+#endif
+#if GSM_ENABLE_QUEUE
+                else if (data.endsWith(GF("C:")) && (data.length() == 2 || data.endsWith(GF(GSM_NL "C:")))) {
+                    // Row of the status table of a queued AT+CIPSTATUS (rows are separated by a single end of line)
+                    char line[80];
+                    streamReadLine(line, sizeof(line));
+                    if (updateConnectionState(line) >= GSM_STATUS_ENTRIES - 1
+                            && cmd_inflight.cmd == GFP(GSM_STATUS) && inflight_state == INFLIGHT_TABLE) {
+                        inflight_state = INFLIGHT_OK; // Last row
                     }
+                    data = "";
                 }
+#endif
                 else if (data.endsWith(GF("CLOSED" GSM_NL))) {
-                    int nl = data.lastIndexOf(GSM_NL, data.length() - 8);
-                    int coma = data.indexOf(',', nl + 2);
-                    int mux = data.substring(nl + 2, coma).toInt();
+                    int mux = urcMux(data, 8);
                     if (mux >= 0 && mux < GSM_MUX_COUNT && sockets[mux]) {
                         sockets[mux]->sock_connected = false;
                         sockets[mux]->sock_available = 0;
                     }
+                    GSM_TRACE(this, GSM_TRACE_URC, mux, GSM_URC_CLOSED);
                     data = "";
                 }
             }
         } while (millis() - startMillis < timeout);
 
+        if (r1) {
+            GSM_STATS(traffic_stats.timeouts++);
+            GSM_TRACE(this, GSM_TRACE_RESPONSE, 0xFF, 0);
+        }
         return index;
     }
 
@@ -1234,43 +3084,972 @@ public:
 
 private:
 
-    Stream& stream;
+#if GSM_ENABLE_RECONNECT
+    /*
+     * Automatic reconnection of a lost connection (see GsmClient::setAutoReconnect()):
+     * the first attempt is scheduled when the loss is noticed, then one attempt is made when due.
+     * Returns true if commands were sent to the modem.
+     */
+    bool reconnectSocket(uint8_t mux) {
+        GsmClient* sock = sockets[mux];
+        if (!sock || !sock->reconnect_armed || sock->sock_connected || commandInFlight()) {
+            return false;
+        }
+        uint32_t now = millis();
+        if (!sock->reconnect_delay) {
+            sock->reconnect_delay = GSM_RECONNECT_MIN_DELAY;
+            sock->reconnect_at = now + reconnectJitter(sock->reconnect_delay);
+            sock->reconnect_attempts = 0;
+            return false;
+        }
+        if ((int32_t) (now - sock->reconnect_at) < 0) {
+            return false;
+        }
+
+        sock->reconnect_attempts++;
+        if (sock->reconnect_reattach && !isGprsConnected()) {
+            if (gprs_apn[0]) {
+                attachGPRS(gprs_apn, gprs_user, gprs_pwd);
+            }
+            else {
+                attachGPRS();
+            }
+        }
+        if (sock->connect(sock->reconnect_host, sock->reconnect_port)) {
+            uint16_t attempts = sock->reconnect_attempts;
+            sock->reconnect_delay = 0;
+            sock->reconnect_attempts = 0;
+            if (sock->reconnect_callback) {
+                sock->reconnect_callback(mux, attempts);
+            }
+        }
+        else {
+            sock->reconnect_delay *= 2;
+            if (sock->reconnect_delay > GSM_RECONNECT_MAX_DELAY) {
+                sock->reconnect_delay = GSM_RECONNECT_MAX_DELAY;
+            }
+            sock->reconnect_at = millis() + reconnectJitter(sock->reconnect_delay);
+        }
+        return true;
+    }
+
+    /*
+     * Random delay between half and all of <delay>, from a xorshift generator seeded on first use
+     * with a hash of the IMEI and the current time, so that devices of a fleet draw different delays
+     * even if random() is never seeded.
+     */
+    uint32_t reconnectJitter(uint32_t delay) {
+        if (!reconnect_seed) {
+            String imei = getIMEI();
+            uint32_t hash = 2166136261UL;
+            for (unsigned i = 0; i < imei.length(); i++) {
+                hash = (hash ^ (uint8_t) imei[i]) * 16777619UL;
+            }
+            reconnect_seed = (hash ^ micros()) | 1;
+        }
+        reconnect_seed ^= reconnect_seed << 13;
+        reconnect_seed ^= reconnect_seed >> 17;
+        reconnect_seed ^= reconnect_seed << 5;
+        return delay - reconnect_seed % (delay / 2 + 1);
+    }
+
+    // APN and credentials used to attach GPRS again (empty <apn> for the default configuration)
+    void gprsRemember(const char* apn, const char* user, const char* pwd) {
+        if (apn == gprs_apn) {
+            return;
+        }
+        gprs_apn[0] = 0;
+        if (!apn || strlen(apn) >= sizeof(gprs_apn) || (user && strlen(user) >= sizeof(gprs_user))
+                || (pwd && strlen(pwd) >= sizeof(gprs_pwd))) {
+            return; // Too long: attach again with attachGPRS()
+        }
+        strcpy(gprs_user, user ? user : "");
+        strcpy(gprs_pwd, pwd ? pwd : "");
+        strcpy(gprs_apn, apn);
+    }
+#endif
+
+#if GSM_ENABLE_TIME
+    /*
+     * Update the network time from a "+CCLK:" line ("yy/MM/dd,hh:mm:ss+zz", local time),
+     * or a "*PSUTTZ:" line (yyyy,M,d,h,m,s,"+z",dst, universal time).
+     */
+    bool updateNetworkTime(const char* line, bool utc) {
+        long fields[7];
+        const char* c = line;
+        for (uint8_t i = 0; i < 7; i++) {
+            while (*c && (*c < '0' || *c > '9') && *c != '+' && *c != '-') {
+                c++;
+            }
+            if (!*c) {
+                return false;
+            }
+            char* end;
+            fields[i] = strtol(c, &end, 10);
+            c = end;
+        }
+        long year = fields[0] < 100 ? 2000 + fields[0] : fields[0];
+        if (year < 2018) {
+            return false; // Modem clock not set
+        }
+        uint32_t epoch = gsmEpoch(year, fields[1], fields[2]) + fields[3] * 3600L + fields[4] * 60L + fields[5];
+        if (!utc) {
+            epoch -= fields[6] * 900L;
+        }
+        time_epoch = epoch;
+        time_millis = millis();
+        time_zone = fields[6];
+        return true;
+    }
+#endif
+
+#if GSM_ENABLE_HTTP
+    // New HTTP session: AT+HTTPINIT on its own (it must complete before the session is configured),
+    // then the parameters set on one command line
+    bool httpBegin(const char* url, bool ssl) {
+        sendAT(GF("+HTTPTERM"));    // Previous session, if any
+        waitResponse();
+        sendAT(GF("+HTTPINIT"));
+        if (waitResponse() != 1) {
+            return false;
+        }
+        CommandBatch batch;
+        batch.add(GF("+HTTPPARA=\"CID\",1"));
+        batch.add(GF("+HTTPPARA=\"URL\",\""), url, GF("\""));
+        batch.add(ssl ? GF("+HTTPSSL=1") : GF("+HTTPSSL=0"));
+        return sendBatch(batch);
+    }
+
+    // Run the request, and wait for its "+HTTPACTION: <method>,<status>,<length>" indication
+    int httpAction(uint8_t method, uint32_t* length, uint32_t timeout) {
+        sendAT(GF("+HTTPACTION="), method);
+        if (waitResponse() != 1) {
+            return 0;
+        }
+        if (waitResponse(timeout, GF(GSM_NL "+HTTPACTION:")) != 1) {
+            return 0;
+        }
+        char line[32];
+        streamReadLine(line, sizeof(line));
+        const char* status = strchr(line, ',');
+        if (!status) {
+            return 0;
+        }
+        const char* len = strchr(status + 1, ',');
+        if (length) {
+            *length = len ? strtoul(len + 1, NULL, 10) : 0;
+        }
+        return atoi(status + 1);
+    }
+#endif
+
+#if GSM_ENABLE_DUTY_CYCLE
+    // Send the data buffered by a client (dropped if it is disconnected). Returns false if some is left.
+    bool flushBatch(GsmClient* sock) {
+        if (!sock->tx_batch_len) {
+            return true;
+        }
+        if (!sock->sock_connected) {
+            sock->tx_batch_len = 0;
+            return false;
+        }
+        handleUrc();
+        size_t sent = modemSend(sock->tx_batch, sock->tx_batch_len, sock->mux);
+        energy_stats.bytesFlushed += sent;
+        sock->tx_batch_len -= sent;
+        memmove(sock->tx_batch, sock->tx_batch + sent, sock->tx_batch_len);
+        return !sock->tx_batch_len;
+    }
+
+    size_t batchedBytes() {
+        size_t total = 0;
+        for (int mux = 0; mux < GSM_MUX_COUNT; mux++) {
+            if (sockets[mux]) {
+                total += sockets[mux]->tx_batch_len;
+            }
+        }
+        return total;
+    }
+
+    bool socketDataPending() {
+        for (int mux = 0; mux < GSM_MUX_COUNT; mux++) {
+            if (sockets[mux] && sockets[mux]->sock_available) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void modemSleep() {
+        if (!sleep_enabled) {
+            sendAT(GF("+CSCLK=1"));
+            if (waitResponse() != 1) {
+                return;
+            }
+            sleep_enabled = true;
+        }
+        dtr_hook(true);
+        modem_sleeping = true;
+        energy_stats.awakeTime += millis() - wake_start;
+    }
+
+    void modemWake() {
+        dtr_hook(false);
+        delay(GSM_WAKE_DELAY);
+        modem_sleeping = false;
+        wake_start = millis();
+        energy_stats.wakeCycles++;
+    }
+#endif
+
+    // Mux of a "<mux>, ..." indication ending <data>, <len> being the length of its text after the mux
+    static int urcMux(const String& data, size_t len) {
+        int nl = data.lastIndexOf(GSM_NL, data.length() - len);
+        int start = nl < 0 ? 0 : nl + 2;
+        int coma = data.indexOf(',', start);
+        if (coma < 0) {
+            return -1;
+        }
+        return data.substring(start, coma).toInt();
+    }
+
+    // "<mux>, CONNECT OK/FAIL" (or "CLOSE OK" when the TLS handshake fails) of a connectAll() connection
+    bool handleConnectResult(String& data) {
+        size_t len;
+        if (data.endsWith(GF("CONNECT OK" GSM_NL))) {
+            len = 12;
+        }
+        else if (data.endsWith(GF("CONNECT FAIL" GSM_NL))) {
+            len = 14;
+        }
+        else if (data.endsWith(GF("CLOSE OK" GSM_NL))) {
+            len = 10;
+        }
+        else {
+            return false;
+        }
+        int mux = urcMux(data, len);
+        if (mux < 0 || mux >= GSM_MUX_COUNT || !sockets[mux] || !sockets[mux]->connect_pending) {
+            return false;
+        }
+        sockets[mux]->sock_connected = (len == 12);
+        sockets[mux]->connect_pending = false;
+        GSM_TRACE(this, GSM_TRACE_URC, mux, GSM_URC_CONNECT);
+        GSM_TRACE(this, GSM_TRACE_STATE, mux, len == 12);
+        connecting--;
+        data = "";
+        return true;
+    }
+
+#if GSM_ENABLE_SMS
+    // Send one SMS, text mode and character set being already configured
+    bool smsSubmit(const char* number, const void* text, size_t len, bool utf16) {
+        sendAT(GF("+CMGS=\""), number, GF("\""));
+        if (waitResponse(GF(">")) != 1) {
+            return false;
+        }
+        if (utf16) {
+            streamWriteHex16((const uint16_t*) text, len);
+        }
+        else {
+            stream.write((const uint8_t*) text, len);
+        }
+        stream.write((char) 0x1A);
+        stream.flush();
+        return waitResponse(60000L) == 1;
+    }
+
+    // Write UTF-16 code units as hex digits, encoded by blocks
+    void streamWriteHex16(const uint16_t* text, size_t len) {
+        char block[64];
+        size_t n = 0;
+        for (size_t i = 0; i < len; i++) {
+            uint16_t c = text[i];
+            block[n++] = GSM_HEX_DIGITS[c >> 12];
+            block[n++] = GSM_HEX_DIGITS[(c >> 8) & 0x0F];
+            block[n++] = GSM_HEX_DIGITS[(c >> 4) & 0x0F];
+            block[n++] = GSM_HEX_DIGITS[c & 0x0F];
+            if (n == sizeof(block)) {
+                stream.write((const uint8_t*) block, n);
+                n = 0;
+            }
+        }
+        if (n) {
+            stream.write((const uint8_t*) block, n);
+        }
+    }
+#endif
+
+#if GSM_ENABLE_DNS_CACHE
+    struct DnsEntry {
+        uint32_t hash;      // Host name hash
+        uint32_t resolved;  // millis() at resolution time
+        uint32_t used;      // millis() at last use
+        uint8_t ip[4];
+        bool valid;
+        bool byName;        // Connection by IP address failed and by name succeeded: use the host name
+    };
+
+    // Cache entry for <host>, even if its address has expired, or NULL
+    DnsEntry* dnsEntry(const char* host) {
+        uint32_t hash = hostHash(host);
+        for (int i = 0; i < GSM_DNS_CACHE_SIZE; i++) {
+            DnsEntry* e = &dns_cache[i];
+            if (e->valid && e->hash == hash) {
+                return e;
+            }
+        }
+        return NULL;
+    }
+
+    // Cache entry for <host> with a non expired address, or NULL
+    DnsEntry* dnsLookup(const char* host) {
+        DnsEntry* e = dnsEntry(host);
+        if (!e || millis() - e->resolved > GSM_DNS_CACHE_TTL) {
+            return NULL;
+        }
+        e->used = millis();
+        return e;
+    }
+#endif
+
+#if GSM_ENABLE_QUEUE
+    struct QueuedCommand {
+        GsmConstStr cmd;        // NULL if free
+        GsmConstStr prefix;
+        GsmResponseCallback callback;
+        uint32_t timeout;
+        uint32_t queued;
+        uint16_t seq;
+        uint8_t priority;
+    };
+
+    bool dataPending() {
+        for (int mux = 0; mux < GSM_MUX_COUNT; mux++) {
+            GsmClient* sock = sockets[mux];
+            if (sock && (sock->sock_available || sock->rx.size())) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    enum {
+        INFLIGHT_LINE,      // Waiting for the line starting with the prefix
+        INFLIGHT_FINAL,     // Waiting for the final result
+        INFLIGHT_TABLE,     // AT+CIPSTATUS: waiting for the last row of the table, which follows "OK"
+        INFLIGHT_OK,
+        INFLIGHT_FAILED,
+    };
+
+    /*
+     * Pick the response of the command in flight from the received data: its line starting with the prefix,
+     * then its final result, which is the first one received as the modem answers commands in order.
+     * Returns true if <data> was consumed.
+     */
+    bool handleInflight(String& data) {
+        if (data.endsWith(GF(GSM_NL "ERROR" GSM_NL))) {
+            inflight_state = INFLIGHT_FAILED; // Also without the expected line
+        }
+        else if (data.endsWith(GF(GSM_NL "+CME ERROR:"))) {
+            streamSkipUntil('\n');
+            inflight_state = INFLIGHT_FAILED;
+        }
+        else if (inflight_state == INFLIGHT_LINE) {
+            if (!data.endsWith(cmd_inflight.prefix)) {
+                return false;
+            }
+            inflight_response = stream.readStringUntil('\n');
+            inflight_response.trim();
+            inflight_state = INFLIGHT_FINAL;
+        }
+        else if (data.endsWith(GF(GSM_NL "OK" GSM_NL))) {
+            if (inflight_state == INFLIGHT_FINAL) {
+                inflight_state = INFLIGHT_OK;
+            }
+        }
+        else {
+            return false;
+        }
+        data = "";
+        return true;
+    }
+
+    // Synchronous commands wait for the response of the queued command in flight (at most its timeout),
+    // as the modem processes one command at a time
+    void waitCommandInFlight() {
+        while (commandInFlight()) {
+            waitResponse(10, NULL, NULL);
+        }
+    }
+
+    /*
+     * Complete the command in flight when its response has been received or has timed out,
+     * then send the queued command of highest priority (oldest first) without waiting for its response.
+     * Returns true if a command was sent.
+     */
+    bool dispatchQueued() {
+        if (cmd_inflight.cmd) {
+            bool done = (inflight_state >= INFLIGHT_OK);
+            if (!done && millis() - cmd_inflight.queued < cmd_inflight.timeout) {
+                return false; // Single command in flight
+            }
+            if (!done) {
+                GSM_STATS(traffic_stats.timeouts++);
+            }
+            GsmResponseCallback callback = cmd_inflight.callback;
+            bool ok = (inflight_state == INFLIGHT_OK);
+            String response = inflight_response;
+            cmd_inflight.cmd = NULL; // Free the slot before the callback, which may queue a command
+            inflight_response = "";
+            if (callback) {
+                callback(ok, response);
+            }
+        }
+
+        QueuedCommand* next = NULL;
+        for (int i = 0; i < GSM_QUEUE_SIZE; i++) {
+            QueuedCommand* q = &cmd_queue[i];
+            if (!q->cmd) {
+                continue;
+            }
+            if (!next || q->priority < next->priority
+                    || (q->priority == next->priority && (uint16_t) (q->seq - next->seq) > 0x8000)) {
+                next = q;
+            }
+        }
+        if (!next) {
+            return false;
+        }
+        if (next->priority >= GSM_PRIO_MANAGEMENT && dataPending()
+                && millis() - next->queued < GSM_QUEUE_MAX_DEFER) {
+            return false;
+        }
+
+        QueuedCommand cmd = *next;
+        next->cmd = NULL;
+        sendAT(cmd.cmd);    // Before taking the slot, which sendAT() waits for
+        cmd_inflight = cmd;
+        cmd_inflight.queued = millis(); // Now the time it was sent
+        if (cmd.cmd == GFP(GSM_STATUS)) {
+            inflight_state = INFLIGHT_TABLE;
+        }
+        else {
+            inflight_state = cmd.prefix ? INFLIGHT_LINE : INFLIGHT_FINAL;
+        }
+        return true;
+    }
+#endif
+
+    // A queued command was sent and neither its response nor its timeout has come yet
+    bool commandInFlight() {
+#if GSM_ENABLE_QUEUE
+        return cmd_inflight.cmd && inflight_state < INFLIGHT_OK && millis() - cmd_inflight.queued < cmd_inflight.timeout;
+#else
+        return false;
+#endif
+    }
+
+    bool pollDue(uint8_t mux) {
+        GsmClient* sock = sockets[mux];
+        if (commandInFlight()) {
+            return false; // Polled once the queued command in flight is answered
+        }
+#if GSM_ENABLE_DUTY_CYCLE
+        if (modem_sleeping && sock && sock->poll_interval) {
+            return false; // Only sockets woken up by "+CIPRXGET: 1"
+        }
+#endif
+        return sock && sock->sock_connected && (millis() - sock->prev_check >= sock->poll_interval);
+    }
+
+    // Query the pending data length of the socket and adapt its polling interval. Returns false if idle.
+    bool pollSocket(uint8_t mux) {
+        GsmClient* sock = sockets[mux];
+        sock->prev_check = millis();
+        sock->sock_available = modemGetAvailable(mux);
+        GSM_STATS(poll_stats.polls++);
+        if (sock->sock_available) {
+            sock->poll_interval = poll_min;
+            return true;
+        }
+        if (sock->poll_interval < poll_min) {
+            sock->poll_interval = poll_min;
+        }
+        else {
+            uint32_t next = (uint32_t) sock->poll_interval * 2;
+            sock->poll_interval = (next < poll_max) ? next : poll_max;
+        }
+        return false;
+    }
+
+    // Process pending URCs
+    void handleUrc() {
+        while (stream.available()) {
+            waitResponse(10, NULL, NULL);
+        }
+    }
+
+    // Query the (GPRS) registration status with AT+CREG?/AT+CGREG?
+    RegStatus queryRegistration(bool gprs) {
+        if (gprs) {
+            sendAT(GF("+CGREG?"));
+        }
+        else {
+            sendAT(GF("+CREG?"));
+        }
+        if (waitResponse(gprs ? GF(GSM_NL "+CGREG:") : GF(GSM_NL "+CREG:")) != 1) {
+            return REG_UNKNOWN;
+        }
+        char line[48];
+        streamReadLine(line, sizeof(line));
+        waitResponse();
+#if GSM_ENABLE_REGISTRATION
+        updateRegistration(gprs, line);
+#endif
+        return parseRegistration(line, NULL, NULL);
+    }
+
+    /*
+     * Parse a "+CREG:"/"+CGREG:" line: <stat>[,"<lac>","<ci>"] for a URC,
+     * or <n>,<stat>[,"<lac>","<ci>"] for a query response.
+     * <lac> and <ci> are only written if present.
+     */
+    static RegStatus parseRegistration(const char* line, uint16_t* lac, uint32_t* ci) {
+        int fields = 1;
+        for (const char* c = line; *c; c++) {
+            if (*c == ',') {
+                fields++;
+            }
+        }
+        const char* pos = line;
+        if (fields == 2 || fields == 4) {
+            pos = strchr(line, ',') + 1; // Skip <n>
+        }
+        const char* q = strchr(pos, '"');
+        if (q && lac) {
+            *lac = strtol(q + 1, NULL, 16);
+        }
+        if (q) {
+            q = strchr(q + 1, '"');            // End of <lac>
+        }
+        if (q) {
+            q = strchr(q + 1, '"');            // Start of <ci>
+        }
+        if (q && ci) {
+            *ci = strtol(q + 1, NULL, 16);
+        }
+        return (RegStatus) atoi(pos);
+    }
+
+#if GSM_ENABLE_REGISTRATION
+    // Update the cached registration from a "+CREG:"/"+CGREG:" line, see parseRegistration()
+    void updateRegistration(bool gprs, const char* line) {
+        RegStatus status = parseRegistration(line, &reg_lac, &reg_ci);
+
+        RegStatus& cached = gprs ? gprs_reg_status : reg_status;
+        bool& known = gprs ? gprs_reg_known : reg_known;
+        bool changed = !known || (cached != status);
+        cached = status;
+        known = true;
+        if (changed && reg_callback) {
+            reg_callback(gprs, status);
+        }
+    }
+#endif
+
+    void sendBatchCommand(CommandBatch& batch, uint8_t i) {
+        stream.print(batch.cmds[i].prefix);
+        if (batch.cmds[i].param) {
+            stream.print(batch.cmds[i].param);
+        }
+        if (batch.cmds[i].suffix) {
+            stream.print(batch.cmds[i].suffix);
+        }
+    }
+
+    SerialT& stream;
     GsmClient* sockets[GSM_MUX_COUNT];
+#if GSM_RX_POOL_BLOCKS
+    GsmRxBlockPool rx_pool;
+#endif
+#if GSM_ENABLE_IDENTITY_CACHE
+    char modem_info[48];
+    char modem_imei[16];
+    char sim_ccid[24];
+#endif
     bool dns_enabled;
-    uint32_t prev_check;
+    uint8_t connecting;
+    uint16_t poll_min;
+    uint16_t poll_max;
+#if GSM_ENABLE_STATS
+    GsmPollStats poll_stats;        // Counters, the intervals are filled by getPollStats()
+    GsmTrafficStats traffic_stats;
+#endif
+#if GSM_ENABLE_QUEUE
+    QueuedCommand cmd_queue[GSM_QUEUE_SIZE];
+    QueuedCommand cmd_inflight;     // Sent, waiting for its response (cmd NULL if none)
+    uint8_t inflight_state;
+    String inflight_response;
+    uint16_t cmd_seq;
+#endif
+    uint8_t poll_next;
+#if GSM_ENABLE_REGISTRATION
+    bool reg_urc;
+    bool reg_known;
+    bool gprs_reg_known;
+    RegStatus reg_status;
+    RegStatus gprs_reg_status;
+    uint16_t reg_lac;
+    uint32_t reg_ci;
+    GsmRegistrationCallback reg_callback;
+#endif
+    const char* dns_primary;        // Owned by the caller of setDnsServers()
+    const char* dns_secondary;
+#if GSM_ENABLE_DNS_CACHE
+    DnsEntry dns_cache[GSM_DNS_CACHE_SIZE];
+#endif
+#if GSM_ENABLE_RECONNECT
+    uint32_t reconnect_seed;    // State of the reconnection jitter generator, 0 until seeded
+    char gprs_apn[GSM_RECONNECT_APN_MAX];
+    char gprs_user[GSM_RECONNECT_APN_MAX];
+    char gprs_pwd[GSM_RECONNECT_APN_MAX];
+#endif
+#if GSM_ENABLE_SMS
+    GsmFifo<uint8_t, GSM_SMS_QUEUE_SIZE + 1> sms_queue;
+#endif
+#if GSM_ENABLE_DUTY_CYCLE
+    uint32_t duty_period;
+    uint16_t duty_threshold;
+    uint32_t duty_last;     // Time of the last flush
+    uint32_t wake_start;
+    GsmDtrCallback dtr_hook;
+    bool sleep_enabled;     // AT+CSCLK=1 set
+    bool modem_sleeping;
+    GsmEnergyStats energy_stats;
+#endif
+#if GSM_ENABLE_TRACE
+    GsmTraceEvent* trace_buf;
+    uint16_t trace_size;
+    uint16_t trace_head;
+    uint32_t trace_count;
+#endif
+#if GSM_ENABLE_TIME
+    uint32_t time_epoch;    // UTC time of the last network time update, 0 if unknown
+    uint32_t time_millis;   // millis() at time_epoch
+    int8_t time_zone;
+#endif
+
+    static inline
+    size_t gsmStrLen(GsmConstStr str) {
+#if defined(__AVR__)
+      return strlen_P(reinterpret_cast<PGM_P>(str));
+#else
+      return strlen(str);
+#endif
+    }
+
+    static inline
+    char gsmStrFirst(GsmConstStr str) {
+      return gsmStrChar(str, 0);
+    }
+
+    static inline
+    char gsmStrChar(GsmConstStr str, size_t i) {
+#if defined(__AVR__)
+      return pgm_read_byte(reinterpret_cast<PGM_P>(str) + i);
+#else
+      return str[i];
+#endif
+    }
 
+#if GSM_ENABLE_DNS_CACHE
+    // FNV-1a hash of a host name (case insensitive)
     static inline
-    String gsmDecodeHex8bit(String &instr) {
-      String result;
-      for (unsigned i=0; i<instr.length(); i+=2) {
-        char buf[4] = { 0, };
-        buf[0] = instr[i];
-        buf[1] = instr[i+1];
-        char b = strtol(buf, NULL, 16);
-        result += b;
+    uint32_t hostHash(const char* host) {
+      uint32_t hash = 2166136261UL;
+      for (; *host; host++) {
+        char c = *host;
+        if (c >= 'A' && c <= 'Z') {
+          c += 'a' - 'A';
+        }
+        hash = (hash ^ (uint8_t) c) * 16777619UL;
       }
-      return result;
+      return hash;
+    }
+#endif
+
+#if GSM_ENABLE_TIME
+    // Seconds from 1970-01-01 to the given date (proleptic Gregorian calendar)
+    static inline
+    uint32_t gsmEpoch(long year, long month, long day) {
+      if (month <= 2) {
+        year--;
+        month += 12;
+      }
+      long days = 365L * year + year / 4 - year / 100 + year / 400 + (153 * (month - 3) + 2) / 5 + day - 719469L;
+      return days * 86400UL;
+    }
+#endif
+
+    static inline
+    bool isIpAddress(const char* host) {
+      for (; *host; host++) {
+        if ((*host < '0' || *host > '9') && *host != '.') {
+          return false;
+        }
+      }
+      return true;
+    }
+
+    static inline
+    String ipToString(IPAddress ip) {
+      String host;
+      host.reserve(16);
+      host += ip[0];
+      host += ".";
+      host += ip[1];
+      host += ".";
+      host += ip[2];
+      host += ".";
+      host += ip[3];
+      return host;
     }
 
     static inline
-    String gsmDecodeHex16bit(String &instr) {
-      String result;
-      for (unsigned i=0; i<instr.length(); i+=4) {
-        char buf[4] = { 0, };
-        buf[0] = instr[i];
-        buf[1] = instr[i+1];
-        char b = strtol(buf, NULL, 16);
-        if (b) { // If high byte is non-zero, we can't handle it ;(
-          result += "?";
-        } else {
-          buf[0] = instr[i+2];
-          buf[1] = instr[i+3];
-          b = strtol(buf, NULL, 16);
-          result += b;
+    IPAddress parseIP(const String& strIP) {
+      int Parts[4] = { 0, };
+      int Part = 0;
+      for (uint8_t i = 0; i < strIP.length(); i++) {
+        char c = strIP[i];
+        if (c == '.') {
+          Part++;
+          if (Part > 3) {
+            return IPAddress(0, 0, 0, 0);
+          }
+          continue;
+        }
+        else if (c >= '0' && c <= '9') {
+          Parts[Part] *= 10;
+          Parts[Part] += c - '0';
+        }
+        else {
+          if (Part == 3)
+            break;
         }
       }
-      return result;
+      return IPAddress(Parts[0], Parts[1], Parts[2], Parts[3]);
+    }
+
+#if GSM_ENABLE_USSD
+    static inline
+    int8_t hexNibble(char c) {
+      if (c >= '0' && c <= '9') {
+        return c - '0';
+      }
+      c |= 0x20; // Lower case
+      if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+      }
+      return -1;
     }
+
+    enum UssdCharset {
+      USSD_7BIT,
+      USSD_8BIT,
+      USSD_UCS2,
+      USSD_UNKNOWN,
+    };
+
+    // Character set of a CBS data coding scheme (3GPP TS 23.038)
+    static inline
+    UssdCharset ussdCharset(int dcs) {
+      switch (dcs >> 4) {
+      case 0x0:
+      case 0x2:
+      case 0x3:
+        return USSD_7BIT;                   // Language using the GSM 7 bit default alphabet
+      case 0x1:
+        if (dcs == 0x10) {
+          return USSD_7BIT;
+        }
+        return (dcs == 0x11) ? USSD_UCS2 : USSD_UNKNOWN;
+      case 0x4:
+      case 0x5:
+      case 0x6:
+      case 0x7:
+      case 0x9:
+        if (dcs & 0x20) {
+          return USSD_UNKNOWN;              // Compressed
+        }
+        switch ((dcs >> 2) & 0x03) {
+        case 0:
+          return USSD_7BIT;
+        case 1:
+          return USSD_8BIT;
+        case 2:
+          return USSD_UCS2;
+        default:
+          return USSD_UNKNOWN;
+        }
+      case 0xF:
+        return (dcs & 0x04) ? USSD_8BIT : USSD_7BIT;
+      default:
+        return USSD_UNKNOWN;
+      }
+    }
+
+    /*
+     * Convert in place the <len> bytes of a USSD answer according to its data coding scheme.
+     * Returns the converted length (at most <size>).
+     */
+    static inline
+    size_t gsmDecodeUssd(int dcs, uint8_t* buf, size_t len, size_t size) {
+      switch (ussdCharset(dcs)) {
+      case USSD_7BIT: {
+        // One septet per byte with CSCS "HEX": same as UCS2, converted forward from the end of the buffer
+        size_t start = size - len;
+        memmove(buf + start, buf, len);
+        return gsm7BitToUtf8(buf + start, len, buf, start);
+      }
+      case USSD_8BIT:
+        return len;
+      case USSD_UCS2: {
+        size_t skip = (dcs == 0x11) ? 2 : 0; // Language indication
+        if (skip > len) {
+          skip = len;
+        }
+        // Move UCS2 data at the end of the buffer, and convert it forward to UTF-8
+        size_t start = size - (len - skip);
+        memmove(buf + start, buf + skip, len - skip);
+        return gsmUcs2ToUtf8(buf + start, len - skip, buf, start);
+      }
+      default: {
+        // Unsupported: back to hex digits, from the end
+        if (len > size / 2) {
+          len = size / 2;
+        }
+        for (size_t i = len; i > 0; i--) {
+          uint8_t b = buf[i - 1];
+          buf[2 * i - 1] = GSM_HEX_DIGITS[b & 0x0F];
+          buf[2 * i - 2] = GSM_HEX_DIGITS[b >> 4];
+        }
+        return 2 * len;
+      }
+      }
+    }
+
+    /*
+     * Convert big endian UCS2/UTF-16 data to UTF-8. <out> may be located before <in> in the same buffer,
+     * <start> being the offset of <in> from <out>: conversion stops before overwriting unread data.
+     */
+    static inline
+    size_t gsmUcs2ToUtf8(const uint8_t* in, size_t len, uint8_t* out, size_t start) {
+      size_t o = 0;
+      size_t i = 0;
+      while (i + 1 < len) {
+        uint32_t cp = ((uint16_t) in[i] << 8) | in[i + 1];
+        size_t next = i + 2;
+        if (cp >= 0xD800 && cp < 0xDC00 && next + 1 < len) {
+          uint16_t lo = ((uint16_t) in[next] << 8) | in[next + 1];
+          if (lo >= 0xDC00 && lo < 0xE000) {
+            cp = 0x10000 + ((cp - 0xD800) << 10) + (lo - 0xDC00);
+            next += 2;
+          }
+        }
+        if (o + gsmUtf8Length(cp) > start + next) {
+          break; // Buffer too small
+        }
+        o += gsmPutUtf8(out + o, cp);
+        i = next;
+      }
+      return o;
+    }
+
+    /*
+     * Convert unpacked GSM 7 bit default alphabet data (one septet per byte, escape sequences for
+     * the extension table) to UTF-8. <out> and <start> are as for gsmUcs2ToUtf8().
+     */
+    static inline
+    size_t gsm7BitToUtf8(const uint8_t* in, size_t len, uint8_t* out, size_t start) {
+      size_t o = 0;
+      size_t i = 0;
+      while (i < len) {
+        uint8_t c = in[i] & 0x7F;
+        size_t next = i + 1;
+        uint32_t cp;
+        if (c == 0x1B && next < len) {
+          c = in[next++] & 0x7F;
+          cp = gsm7BitExtension(c);
+        }
+        else {
+#if defined(__AVR__)
+          cp = pgm_read_word(&GSM_7BIT_ALPHABET[c]);
+#else
+          cp = GSM_7BIT_ALPHABET[c];
+#endif
+        }
+        if (o + gsmUtf8Length(cp) > start + next) {
+          break; // Buffer too small
+        }
+        o += gsmPutUtf8(out + o, cp);
+        i = next;
+      }
+      return o;
+    }
+
+    // Character of the GSM 7 bit default alphabet extension table (after an escape), or a space if unassigned
+    static inline
+    uint32_t gsm7BitExtension(uint8_t c) {
+      switch (c) {
+      case 0x0A: return 0x000C;             // Page break
+      case 0x14: return '^';
+      case 0x28: return '{';
+      case 0x29: return '}';
+      case 0x2F: return '\\';
+      case 0x3C: return '[';
+      case 0x3D: return '~';
+      case 0x3E: return ']';
+      case 0x40: return '|';
+      case 0x65: return 0x20AC;             // Euro sign
+      default:   return ' ';
+      }
+    }
+
+    static inline
+    uint8_t gsmUtf8Length(uint32_t cp) {
+      return (cp < 0x80) ? 1 : (cp < 0x800) ? 2 : (cp < 0x10000) ? 3 : 4;
+    }
+
+    // Write the UTF-8 encoding of <cp> in <out>. Returns its length.
+    static inline
+    uint8_t gsmPutUtf8(uint8_t* out, uint32_t cp) {
+      uint8_t n = gsmUtf8Length(cp);
+      switch (n) {
+      case 1:
+        out[0] = cp;
+        break;
+      case 2:
+        out[0] = 0xC0 | (cp >> 6);
+        out[1] = 0x80 | (cp & 0x3F);
+        break;
+      case 3:
+        out[0] = 0xE0 | (cp >> 12);
+        out[1] = 0x80 | ((cp >> 6) & 0x3F);
+        out[2] = 0x80 | (cp & 0x3F);
+        break;
+      default:
+        out[0] = 0xF0 | (cp >> 18);
+        out[1] = 0x80 | ((cp >> 12) & 0x3F);
+        out[2] = 0x80 | ((cp >> 6) & 0x3F);
+        out[3] = 0x80 | (cp & 0x3F);
+        break;
+      }
+      return n;
+    }
+#endif
 };
 
+typedef BasicHeraclesGsmModem<Stream> HeraclesGsmModem;
+
 #endif
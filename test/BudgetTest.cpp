@@ -0,0 +1,172 @@
+/*
+ * Copyright (C) 2018 Orange
+ *
+ * This software is distributed under the terms and conditions of the GNU Lesser
+ * General Public License (LGPL-3.0) which can be found in the file 'LICENSE.txt'
+ * in this package distribution.
+ */
+
+/*
+ * AT round-trip budget: runs the canonical scenarios against FakeModem, and checks the
+ * commands, bytes on the wire (both directions) and simulated time of each one against
+ * the budget file given as argument. Fails if any scenario goes over its budget.
+ */
+
+#include "TestModem.h"
+#include <map>
+
+struct Cost {
+    unsigned long commands;
+    unsigned long bytes;
+    unsigned long time;     // ms
+};
+
+class Scenario : public TestModem
+{
+public:
+    void start(void)
+    {
+        fake.clearCounters();
+        _start = millis();
+    }
+
+    Cost cost(void)
+    {
+        Cost c = { fake.commands, fake.bytesToModem + fake.bytesFromModem, millis() - _start };
+        return c;
+    }
+
+    // Call maintain() every 10 ms for <ms> ms
+    void run(unsigned long ms)
+    {
+        for (unsigned long start = millis(); millis() - start < ms;) {
+            modem.maintain();
+            delay(10);
+        }
+    }
+
+private:
+    unsigned long _start;
+};
+
+static Cost attach(void)
+{
+    Scenario s;
+    s.modem.init();
+    s.start();
+    s.modem.attachGPRS("apn", "", "");
+    return s.cost();
+}
+
+static Cost connect(void)
+{
+    Scenario s;
+    s.attach();
+    s.start();
+    s.client.connect("1.2.3.4", 80);
+    return s.cost();
+}
+
+static Cost send1k(void)
+{
+    Scenario s;
+    s.connect();
+    uint8_t data[1024];
+    memset(data, 'x', sizeof(data));
+    s.start();
+    s.client.write(data, sizeof(data));
+    return s.cost();
+}
+
+static Cost receive4k(void)
+{
+    Scenario s;
+    s.connect();
+    s.run(1000);
+    s.start();
+    s.fake.receive(0, std::string(4096, 'x'));
+    uint8_t data[256];
+    size_t got = 0;
+    for (unsigned long start = millis(); got < 4096 && millis() - start < 60000;) {
+        s.modem.maintain();
+        got += s.client.read(data, sizeof(data));
+    }
+    return s.cost();
+}
+
+static Cost idle10s(void)
+{
+    Scenario s;
+    s.connect();
+    s.start();
+    s.run(10000);
+    return s.cost();
+}
+
+static Cost reconnect(void)
+{
+    Scenario s;
+    s.connect();
+    s.fake.close(0);
+    s.run(100);
+    s.start();
+    s.client.stop();
+    s.client.connect("1.2.3.4", 80);
+    return s.cost();
+}
+
+struct Entry {
+    const char* name;
+    Cost (*run)(void);
+};
+
+static const Entry scenarios[] = {
+    { "connect", connect },
+    { "send_1k", send1k },
+    { "receive_4k", receive4k },
+    { "idle_10s", idle10s },
+    { "reconnect", reconnect },
+    { "attach", attach },
+};
+
+int main(int argc, char** argv)
+{
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s <budget file>\n", argv[0]);
+        return 2;
+    }
+    FILE* f = fopen(argv[1], "r");
+    if (!f) {
+        fprintf(stderr, "can't open %s\n", argv[1]);
+        return 2;
+    }
+    std::map<std::string, Cost> budget;
+    char line[128];
+    while (fgets(line, sizeof(line), f)) {
+        char name[32];
+        Cost c;
+        if (line[0] != '#' && sscanf(line, "%31s %lu %lu %lu", name, &c.commands, &c.bytes, &c.time) == 4)
+            budget[name] = c;
+    }
+    fclose(f);
+
+    printf("%-12s %9s %9s %9s\n", "scenario", "commands", "bytes", "time_ms");
+    for (size_t i = 0; i < sizeof(scenarios) / sizeof(scenarios[0]); i++) {
+        Cost c = scenarios[i].run();
+        printf("%-12s %9lu %9lu %9lu", scenarios[i].name, c.commands, c.bytes, c.time);
+        if (!budget.count(scenarios[i].name)) {
+            printf("  FAIL: no budget\n");
+            failures++;
+            continue;
+        }
+        const Cost& b = budget[scenarios[i].name];
+        if (c.commands > b.commands || c.bytes > b.bytes || c.time > b.time) {
+            printf("  FAIL: over budget (%lu %lu %lu)\n", b.commands, b.bytes, b.time);
+            failures++;
+        }
+        else {
+            printf("\n");
+        }
+    }
+    return failures ? 1 : 0;
+}
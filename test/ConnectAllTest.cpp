@@ -0,0 +1,70 @@
+/*
+ * Copyright (C) 2018 Orange
+ *
+ * This software is distributed under the terms and conditions of the GNU Lesser
+ * General Public License (LGPL-3.0) which can be found in the file 'LICENSE.txt'
+ * in this package distribution.
+ */
+
+/*
+ * connectAll() selects the host like GsmClient::connect(): SSL connections by name,
+ * others by cached IP address, falling back on the name when the connection by address fails.
+ */
+
+#define GSM_ENABLE_DNS_CACHE 1
+#include "TestModem.h"
+
+int main(void)
+{
+    TestModem t;
+    FakeModem& fake = t.fake;
+    HeraclesGsmModem::GsmClient secure(t.modem, 1, true);
+
+    // While proxy is set, the server of connection 0 only accepts connections by name
+    bool proxy = false;
+    fake.hook = [&fake, &proxy](const std::string& cmd) {
+        if (proxy && cmd.compare(0, 12, "+CIPSTART=0,") == 0 && cmd.find("1.2.3.4") != std::string::npos) {
+            fake.emit("\r\nOK\r\n", fake.latency);
+            fake.emitLater("\r\n0, CONNECT FAIL\r\n", 100);
+            return true;
+        }
+        return false;
+    };
+
+    CHECK(t.attach());
+
+    HeraclesGsmModem::GsmClient* clients[] = { &t.client, &secure };
+    const char* hosts[] = { "api.example.com", "broker.example.com" };
+    const uint16_t ports[] = { 80, 8883 };
+
+    // By address, and SSL by name without resolution
+    fake.clearCounters();
+    CHECK(t.modem.connectAll(clients, hosts, ports, 2) == 2);
+    CHECK(fake.count("+CIPSTART=0,\"TCP\",\"1.2.3.4\",80") == 1);
+    CHECK(fake.count("+CIPSTART=1,\"TCP\",\"broker.example.com\",8883") == 1);
+    CHECK(fake.count("+CIPSTART=") == 2);
+    CHECK(fake.count("+CDNSGIP=\"broker") == 0);
+    CHECK(t.client.connected() && secure.connected());
+    t.client.stop();
+    secure.stop();
+
+    // Connection by address refused: by name
+    proxy = true;
+    hosts[0] = "vhost.example.com";
+    fake.clearCounters();
+    CHECK(t.modem.connectAll(clients, hosts, ports, 2) == 2);
+    CHECK(fake.count("+CIPSTART=0,\"TCP\",\"1.2.3.4\"") == 1);
+    CHECK(fake.count("+CIPSTART=0,\"TCP\",\"vhost.example.com\"") == 1);
+    CHECK(t.client.connected() && secure.connected());
+    t.client.stop();
+    secure.stop();
+
+    // The name is kept while the address is valid
+    fake.clearCounters();
+    CHECK(t.modem.connectAll(clients, hosts, ports, 2) == 2);
+    CHECK(fake.count("+CDNSGIP=") == 0);
+    CHECK(fake.count("+CIPSTART=0,") == 1);
+    CHECK(fake.count("+CIPSTART=0,\"TCP\",\"vhost.example.com\"") == 1);
+
+    return failures ? 1 : 0;
+}
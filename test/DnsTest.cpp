@@ -0,0 +1,81 @@
+/*
+ * Copyright (C) 2018 Orange
+ *
+ * This software is distributed under the terms and conditions of the GNU Lesser
+ * General Public License (LGPL-3.0) which can be found in the file 'LICENSE.txt'
+ * in this package distribution.
+ */
+
+/*
+ * Host name connections with the DNS cache: a host refusing connections by IP address is
+ * connected by name until its address expires, a failure of both connections (e.g. outage)
+ * doesn't switch to the name, and SSL connections never use the address.
+ */
+
+#define GSM_ENABLE_DNS_CACHE 1
+#include "TestModem.h"
+
+int main(void)
+{
+    TestModem t;
+    FakeModem& fake = t.fake;
+    HeraclesGsmModem::GsmClient& client = t.client;
+    HeraclesGsmModem::GsmClient secure(t.modem, 1, true);
+
+    // The server only accepts connections by name (e.g. virtual host behind a proxy)
+    bool proxy = true;
+    fake.hook = [&fake, &proxy](const std::string& cmd) {
+        if (proxy && cmd.compare(0, 12, "+CIPSTART=0,") == 0 && cmd.find("1.2.3.4") != std::string::npos) {
+            fake.emit("\r\nOK\r\n", fake.latency);
+            fake.emit("\r\n0, CONNECT FAIL\r\n", 100);
+            return true;
+        }
+        return false;
+    };
+
+    CHECK(t.attach());
+
+    fake.clearCounters();
+    CHECK(client.connect("example.com", 80));
+    CHECK(fake.count("+CDNSGIP=") == 1);
+    CHECK(fake.count("+CIPSTART=0,\"TCP\",\"1.2.3.4\"") == 1);
+    CHECK(fake.count("+CIPSTART=0,\"TCP\",\"example.com\"") == 1);
+    client.stop();
+
+    // Connected by name at once while the address is valid
+    fake.clearCounters();
+    CHECK(client.connect("example.com", 80));
+    CHECK(fake.count("+CDNSGIP=") == 0);
+    CHECK(fake.count("+CIPSTART=") == 1);
+    client.stop();
+
+    // Address expired: resolved and tried again
+    delay(GSM_DNS_CACHE_TTL + 1000);
+    fake.clearCounters();
+    CHECK(client.connect("example.com", 80));
+    CHECK(fake.count("+CDNSGIP=") == 1);
+    CHECK(fake.count("+CIPSTART=") == 2);
+    client.stop();
+
+    // Outage: both connections fail, the address is still used afterwards
+    proxy = false;
+    fake.refuseConnect = true;
+    fake.clearCounters();
+    CHECK(!client.connect("other.example.com", 80));
+    CHECK(fake.count("+CIPSTART=0,\"TCP\",\"other.example.com\"") == 1);
+    fake.refuseConnect = false;
+    fake.clearCounters();
+    CHECK(client.connect("other.example.com", 80));
+    CHECK(fake.count("+CDNSGIP=") == 0);
+    CHECK(fake.count("+CIPSTART=0,\"TCP\",\"1.2.3.4\"") == 1);
+    CHECK(fake.count("+CIPSTART=") == 1);
+    client.stop();
+
+    // SSL: the host name is always used, without resolution
+    fake.clearCounters();
+    CHECK(secure.connect("secure.example.com", 443));
+    CHECK(fake.count("+CDNSGIP=") == 0);
+    CHECK(fake.count("+CIPSTART=1,\"TCP\",\"secure.example.com\"") == 1);
+
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,70 @@
+/*
+ * Copyright (C) 2018 Orange
+ *
+ * This software is distributed under the terms and conditions of the GNU Lesser
+ * General Public License (LGPL-3.0) which can be found in the file 'LICENSE.txt'
+ * in this package distribution.
+ */
+
+/*
+ * Duty cycling: a sensor writing 20 bytes per second for a minute, with writes batched
+ * every 10 s and the modem sleeping in between (AT+CSCLK=1, DTR high), compared with
+ * immediate writes. Prints the radio-on time of both; all data must be delivered, no command lost.
+ */
+
+#define GSM_ENABLE_DUTY_CYCLE 1
+#include "TestModem.h"
+
+static FakeModem* dtrModem = NULL;
+
+static void onDtr(bool high)
+{
+    dtrModem->dtr(high);
+}
+
+// Radio-on time (ms) of a minute of writes
+static unsigned long sensorMinute(TestModem& t, uint32_t period)
+{
+    t.modem.setDutyCycle(period, GSM_TX_BATCH_BUFFER, period ? onDtr : NULL);
+    unsigned long awake = t.fake.awakeTime();
+    unsigned long start = millis();
+    unsigned long next = start;
+    while (millis() - start < 60000) {
+        if (millis() >= next) {
+            CHECK(t.client.write((const uint8_t*) "temperature=21.5;h=4", 20) == 20);
+            next += 1000;
+        }
+        t.modem.maintain();
+        delay(10);
+    }
+    t.modem.setDutyCycle(0);
+    return t.fake.awakeTime() - awake;
+}
+
+int main(void)
+{
+    TestModem t;
+    dtrModem = &t.fake;
+    CHECK(t.connect());
+
+    unsigned long immediate = sensorMinute(t, 0);
+    CHECK(t.fake.sent[0].size() == 60 * 20);
+    t.fake.sent[0].clear();
+
+    unsigned long cycled = sensorMinute(t, 10000);
+    GsmEnergyStats stats = t.modem.getEnergyStats();
+    printf("radio on for %lu ms immediate, %lu ms duty cycled (%lu wake cycles)\n",
+           immediate, cycled, (unsigned long) stats.wakeCycles);
+    CHECK(t.fake.sent[0].size() == 60 * 20);
+    CHECK(t.fake.lostAsleep == 0);
+    CHECK(immediate >= 59000);
+    CHECK(cycled < immediate / 10);
+    CHECK(stats.wakeCycles >= 6 && stats.wakeCycles <= 12); // Every 10 s, or when the write buffer is full
+
+    // A write on a closed connection is refused, not buffered
+    t.modem.setDutyCycle(10000, 512, onDtr);
+    t.client.stop();
+    CHECK(t.client.write((const uint8_t*) "lost", 4) == 0);
+
+    return failures ? 1 : 0;
+}
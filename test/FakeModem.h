@@ -0,0 +1,383 @@
+/*
+ * Copyright (C) 2018 Orange
+ *
+ * This software is distributed under the terms and conditions of the GNU Lesser
+ * General Public License (LGPL-3.0) which can be found in the file 'LICENSE.txt'
+ * in this package distribution.
+ */
+
+#ifndef __FakeModem_h
+#define __FakeModem_h
+
+#include <Arduino.h>
+#include <stdio.h>
+#include <deque>
+#include <functional>
+#include <string>
+#include <vector>
+
+/*
+ * Scripted SIM800/Heracles modem on a simulated 115200 bauds serial line:
+ * each byte takes FakeModem::BYTE_TIME us on the wire, and each response is sent
+ * after FakeModem::latency ms. Responses follow the SIM800 formats, including the
+ * AT+CIPSTATUS table (rows separated by a single end of line) and ESC in data mode.
+ * Connections 0 to 5 are remote TCP peers: what the host sends is appended to sent[],
+ * and what is put in remote[] is returned by AT+CIPRXGET.
+ * Like the modem, it processes one command at a time: a command line received before
+ * the response to the previous one is complete is counted in overlapped and ignored.
+ * Sleep mode 1: once AT+CSCLK=1 is set, the modem sleeps while DTR is high (see dtr()),
+ * the commands received meanwhile being lost; awakeTime() is the time the radio was on.
+ */
+class FakeModem : public Stream
+{
+public:
+    enum { CONNECTIONS = 6, BYTE_TIME = 87 };
+
+    // Wire counters, since the last clearCounters()
+    unsigned commands;
+    unsigned long bytesToModem;
+    unsigned long bytesFromModem;
+    std::vector<std::string> log;   // Commands received, without "AT"
+
+    unsigned latency;               // ms
+    unsigned connectLatency;        // ms between "OK" and "<n>, CONNECT OK"
+    unsigned locationLatency;       // ms before the answer to AT+CIPGSMLOC
+    bool refuseConnect;
+    bool attached;                  // GPRS, as reported by AT+CGATT?
+    std::string imei;
+    bool connected[CONNECTIONS];
+    std::string remote[CONNECTIONS];
+    std::string sent[CONNECTIONS];
+    unsigned cancelled;             // AT+CIPSEND cancelled with ESC
+    unsigned overlapped;            // Commands received while the previous one was in progress
+    unsigned lostAsleep;            // Commands received while asleep
+
+    // Called first with each command: returns true if it handled the command
+    std::function<bool(const std::string&)> hook;
+
+    FakeModem() : latency(5), connectLatency(300), locationLatency(8000), refuseConnect(false),
+        attached(false), imei("860000000000001"), cancelled(0), overlapped(0), lostAsleep(0), _dataMux(-1), _dataLeft(0), _last(0), _busyUntil(0),
+        _slowClock(false), _dtrHigh(false), _awakeSince(mockClock()), _awake(0)
+    {
+        for (int i = 0; i < CONNECTIONS; i++)
+            connected[i] = false;
+        clearCounters();
+    }
+
+    void clearCounters(void)
+    {
+        commands = 0;
+        bytesToModem = 0;
+        bytesFromModem = 0;
+        log.clear();
+    }
+
+    // Number of commands received (in log) starting with <prefix>
+    unsigned count(const std::string& prefix) const
+    {
+        unsigned n = 0;
+        for (size_t i = 0; i < log.size(); i++) {
+            if (log[i].compare(0, prefix.size(), prefix) == 0)
+                n++;
+        }
+        return n;
+    }
+
+    // Send <text> to the host <delay> ms from now (after any pending output)
+    void emit(const std::string& text, unsigned long delay = 0)
+    {
+        uint64_t t = mockClock() + delay * 1000ULL;
+        if (t < _last)
+            t = _last;
+        for (size_t i = 0; i < text.size(); i++) {
+            t += BYTE_TIME;
+            _out.push_back(Byte { (uint8_t) text[i], t });
+        }
+        _last = t;
+    }
+
+    // Send <text> to the host <delay> ms from now, as soon as the line is idle: unlike emit(),
+    // the responses to the commands received meanwhile are not held back (unsolicited result code)
+    void emitLater(const std::string& text, unsigned long delay)
+    {
+        _later.push_back(Later { text, mockClock() + delay * 1000ULL });
+    }
+
+    // DTR pin, driven by the host
+    void dtr(bool high)
+    {
+        bool asleep = sleeping();
+        _dtrHigh = high;
+        sleepChanged(asleep);
+    }
+
+    bool sleeping(void) const
+    {
+        return _slowClock && _dtrHigh;
+    }
+
+    // Time (ms) the modem was awake since its creation
+    unsigned long awakeTime(void) const
+    {
+        return (_awake + (sleeping() ? 0 : mockClock() - _awakeSince)) / 1000;
+    }
+
+    // Peer side of connection <mux>: data arrives, signalled by "+CIPRXGET: 1,<mux>"
+    void receive(int mux, const std::string& data, unsigned long delay = 0)
+    {
+        remote[mux] += data;
+        char urc[32];
+        snprintf(urc, sizeof(urc), "\r\n+CIPRXGET: 1,%d\r\n", mux);
+        emitLater(urc, delay);
+    }
+
+    // Peer side of connection <mux>: the peer closes the connection
+    void close(int mux, bool notify = true)
+    {
+        connected[mux] = false;
+        if (notify) {
+            char urc[32];
+            snprintf(urc, sizeof(urc), "\r\n%d, CLOSED\r\n", mux);
+            emit(urc);
+        }
+    }
+
+    // Stream interface (host side)
+    //-------------------------------------------------------------
+
+    virtual int available(void)
+    {
+        pump();
+        int n = 0;
+        for (size_t i = 0; i < _out.size() && _out[i].time <= mockClock(); i++)
+            n++;
+        return n;
+    }
+
+    virtual int peek(void)
+    {
+        pump();
+        return (!_out.empty() && _out.front().time <= mockClock()) ? _out.front().c : -1;
+    }
+
+    virtual int read(void)
+    {
+        int c = peek();
+        if (c >= 0) {
+            _out.pop_front();
+            bytesFromModem++;
+        }
+        return c;
+    }
+
+    using Print::write;
+
+    virtual size_t write(uint8_t c)
+    {
+        mockAdvance(BYTE_TIME);
+        bytesToModem++;
+        if (_dataLeft) {
+            dataByte(c);
+            return 1;
+        }
+        _line += (char) c;
+        if (_line.size() >= 2 && _line.compare(_line.size() - 2, 2, "\r\n") == 0) {
+            std::string line = _line.substr(0, _line.size() - 2);
+            _line.clear();
+            if (line.compare(0, 2, "AT") == 0)
+                command(line.substr(2));
+        }
+        return 1;
+    }
+
+private:
+    struct Byte {
+        uint8_t c;
+        uint64_t time;
+    };
+
+    struct Later {
+        std::string text;
+        uint64_t time;
+    };
+
+    void pump(void)
+    {
+        for (size_t i = 0; i < _later.size(); i++) {
+            if (_later[i].time <= mockClock() && _last <= mockClock()) {
+                std::string text = _later[i].text;
+                _later.erase(_later.begin() + i);
+                emit(text);
+                return;
+            }
+        }
+    }
+
+    void reply(const std::string& text)
+    {
+        emit(text, latency);
+    }
+
+    void dataByte(uint8_t c)
+    {
+        if (c == 0x1B) {
+            // ESC: the transaction is cancelled, nothing is sent
+            _dataLeft = 0;
+            _data.clear();
+            cancelled++;
+            reply("\r\nOK\r\n");
+            return;
+        }
+        _data += (char) c;
+        if (--_dataLeft == 0) {
+            sent[_dataMux] += _data;
+            char rsp[40];
+            snprintf(rsp, sizeof(rsp), "\r\nDATA ACCEPT:%d,%u\r\n", _dataMux, (unsigned) _data.size());
+            _data.clear();
+            reply(rsp);
+        }
+    }
+
+    void sleepChanged(bool asleep)
+    {
+        if (!asleep && sleeping())
+            _awake += mockClock() - _awakeSince;
+        else if (asleep && !sleeping())
+            _awakeSince = mockClock();
+    }
+
+    void command(const std::string& cmd)
+    {
+        if (sleeping()) {
+            lostAsleep++;
+            return;
+        }
+        if (mockClock() < _busyUntil) {
+            overlapped++;
+            return;
+        }
+        commands++;
+        log.push_back(cmd);
+        if (!hook || !hook(cmd))
+            respond(cmd);
+        _busyUntil = _last;
+    }
+
+    void respond(const std::string& cmd)
+    {
+
+        char rsp[128];
+        int mux;
+        unsigned n;
+        if (cmd == "+CPIN?") {
+            reply("\r\n+CPIN: READY\r\n\r\nOK\r\n");
+        }
+        else if (cmd == "+CREG?" || cmd == "+CGREG?") {
+            reply("\r\n" + cmd.substr(0, cmd.size() - 1) + ": 2,1,\"1A2B\",\"00C3\"\r\n\r\nOK\r\n");
+        }
+        else if (cmd == "+CSCLK=0" || cmd == "+CSCLK=1") {
+            reply("\r\nOK\r\n");
+            bool asleep = sleeping();
+            _slowClock = (cmd == "+CSCLK=1");
+            sleepChanged(asleep);
+        }
+        else if (cmd == "+CGATT?") {
+            reply(attached ? "\r\n+CGATT: 1\r\n\r\nOK\r\n" : "\r\n+CGATT: 0\r\n\r\nOK\r\n");
+        }
+        else if (cmd.compare(0, 6, "+CGATT") == 0) {
+            attached = (cmd == "+CGATT=1");
+            reply("\r\nOK\r\n");
+        }
+        else if (cmd == "+GSN") {
+            reply("\r\n" + imei + "\r\n\r\nOK\r\n");
+        }
+        else if (cmd.compare(0, 5, "+CIFSR") == 0) {
+            reply("\r\n10.0.0.2\r\n\r\nOK\r\n");
+        }
+        else if (cmd == "+CIPSHUT") {
+            for (int i = 0; i < CONNECTIONS; i++)
+                connected[i] = false;
+            reply("\r\nSHUT OK\r\n");
+        }
+        else if (cmd == "+CIPSTATUS") {
+            std::string table = "\r\nOK\r\n\r\nSTATE: IP PROCESSING\r\n\r\n";
+            for (int i = 0; i < CONNECTIONS; i++) {
+                if (connected[i])
+                    snprintf(rsp, sizeof(rsp), "C: %d,0,\"TCP\",\"1.2.3.4\",\"80\",\"CONNECTED\"\r\n", i);
+                else
+                    snprintf(rsp, sizeof(rsp), "C: %d,,\"\",\"\",\"\",\"INITIAL\"\r\n", i);
+                table += rsp;
+            }
+            reply(table);
+        }
+        else if (sscanf(cmd.c_str(), "+CIPSTATUS=%d", &mux) == 1) {
+            snprintf(rsp, sizeof(rsp), "\r\n+CIPSTATUS: %d,0,\"TCP\",\"1.2.3.4\",\"80\",\"%s\"\r\n\r\nOK\r\n",
+                     mux, connected[mux] ? "CONNECTED" : "CLOSED");
+            reply(rsp);
+        }
+        else if (sscanf(cmd.c_str(), "+CIPSTART=%d", &mux) == 1) {
+            reply("\r\nOK\r\n");
+            connected[mux] = !refuseConnect;
+            snprintf(rsp, sizeof(rsp), "\r\n%d, CONNECT %s\r\n", mux, refuseConnect ? "FAIL" : "OK");
+            emitLater(rsp, connectLatency);
+        }
+        else if (sscanf(cmd.c_str(), "+CIPCLOSE=%d", &mux) == 1) {
+            connected[mux] = false;
+            snprintf(rsp, sizeof(rsp), "\r\n%d, CLOSE OK\r\n", mux);
+            reply(rsp);
+        }
+        else if (cmd == "+CIPSEND?") {
+            std::string list;
+            for (int i = 0; i < CONNECTIONS; i++) {
+                snprintf(rsp, sizeof(rsp), "\r\n+CIPSEND: %d,%d", i, connected[i] ? 1460 : 0);
+                list += rsp;
+            }
+            reply(list + "\r\n\r\nOK\r\n");
+        }
+        else if (sscanf(cmd.c_str(), "+CIPSEND=%d,%u", &mux, &n) == 2) {
+            if (!connected[mux] || n == 0 || n > 1460) {
+                reply("\r\nERROR\r\n");
+                return;
+            }
+            _dataMux = mux;
+            _dataLeft = n;
+            reply("\r\n> ");
+        }
+        else if (sscanf(cmd.c_str(), "+CIPRXGET=4,%d", &mux) == 1) {
+            snprintf(rsp, sizeof(rsp), "\r\n+CIPRXGET: 4,%d,%u\r\n\r\nOK\r\n", mux, (unsigned) remote[mux].size());
+            reply(rsp);
+        }
+        else if (sscanf(cmd.c_str(), "+CIPRXGET=2,%d,%u", &mux, &n) == 2) {
+            std::string data = remote[mux].substr(0, n);
+            remote[mux].erase(0, data.size());
+            snprintf(rsp, sizeof(rsp), "\r\n+CIPRXGET: 2,%d,%u,%u\r\n", mux, (unsigned) data.size(),
+                     (unsigned) remote[mux].size());
+            reply(rsp + data + "\r\nOK\r\n");
+        }
+        else if (cmd.compare(0, 9, "+CDNSGIP=") == 0) {
+            reply("\r\nOK\r\n");
+            emitLater("\r\n+CDNSGIP: 1," + cmd.substr(9) + ",\"1.2.3.4\"\r\n", 100);
+        }
+        else if (cmd.compare(0, 11, "+CIPGSMLOC=") == 0) {
+            emit("\r\n+CIPGSMLOC: 0,2.294500,48.858400,2018/01/01,12:00:00\r\n\r\nOK\r\n", locationLatency);
+        }
+        else {
+            reply("\r\nOK\r\n");
+        }
+    }
+
+    std::deque<Byte> _out;
+    std::vector<Later> _later;
+    std::string _line;
+    std::string _data;
+    int _dataMux;
+    unsigned _dataLeft;
+    uint64_t _last;
+    uint64_t _busyUntil;            // End of the response to the last command
+    bool _slowClock;                // AT+CSCLK=1
+    bool _dtrHigh;
+    uint64_t _awakeSince;
+    uint64_t _awake;                // us awake until _awakeSince
+};
+
+#endif
@@ -0,0 +1,54 @@
+/*
+ * Copyright (C) 2018 Orange
+ *
+ * This software is distributed under the terms and conditions of the GNU Lesser
+ * General Public License (LGPL-3.0) which can be found in the file 'LICENSE.txt'
+ * in this package distribution.
+ */
+
+/*
+ * HTTP session setup: AT+HTTPINIT is sent alone and completed before the session parameters,
+ * which are set on one command line (the modem rejects AT+HTTPINIT chained with other commands).
+ */
+
+#define GSM_ENABLE_HTTP 1
+#include "TestModem.h"
+
+int main(void)
+{
+    TestModem t;
+    FakeModem& fake = t.fake;
+    HeraclesGsmModem& modem = t.modem;
+
+    fake.hook = [&fake](const std::string& cmd) {
+        if (cmd.compare(0, 9, "+HTTPINIT") == 0 && cmd != "+HTTPINIT") {
+            fake.emit("\r\nERROR\r\n", fake.latency);
+            return true;
+        }
+        if (cmd == "+HTTPACTION=0") {
+            fake.emit("\r\nOK\r\n", fake.latency);
+            fake.emit("\r\n+HTTPACTION: 0,200,5\r\n", 500);
+            return true;
+        }
+        return false;
+    };
+
+    modem.init();
+    fake.clearCounters();
+    uint32_t length = 0;
+    CHECK(modem.httpGet("http://example.com/", &length) == 200);
+    CHECK(length == 5);
+
+    for (size_t i = 0; i < fake.log.size(); i++) {
+        printf("AT%s\n", fake.log[i].c_str());
+    }
+    CHECK(fake.log.size() == 4);
+    if (fake.log.size() == 4) {
+        CHECK(fake.log[0] == "+HTTPTERM");
+        CHECK(fake.log[1] == "+HTTPINIT");
+        CHECK(fake.log[2] == "+HTTPPARA=\"CID\",1;+HTTPPARA=\"URL\",\"http://example.com/\";+HTTPSSL=0");
+        CHECK(fake.log[3] == "+HTTPACTION=0");
+    }
+
+    return failures ? 1 : 0;
+}
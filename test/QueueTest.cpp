@@ -0,0 +1,110 @@
+/*
+ * Copyright (C) 2018 Orange
+ *
+ * This software is distributed under the terms and conditions of the GNU Lesser
+ * General Public License (LGPL-3.0) which can be found in the file 'LICENSE.txt'
+ * in this package distribution.
+ */
+
+/*
+ * Command queue: a slow queued command (AT+CIPGSMLOC, answered after 8 s) is in flight
+ * without blocking the application: socket I/O waits for its response, as the modem handles
+ * one command at a time, and the response reaches the callback. An error answer completes
+ * the command at once. Queued commands are sent in priority order.
+ */
+
+#define GSM_ENABLE_QUEUE 1
+#include "TestModem.h"
+
+static int callbacks = 0;
+static bool callbackOk = false;
+static String callbackResponse;
+
+static void onResponse(bool ok, const String& response)
+{
+    callbacks++;
+    callbackOk = ok;
+    callbackResponse = response;
+}
+
+int main(void)
+{
+    TestModem t;
+    FakeModem& fake = t.fake;
+    HeraclesGsmModem& modem = t.modem;
+    HeraclesGsmModem::GsmClient& client = t.client;
+    CHECK(t.connect());
+
+    // Location in flight, data received 1 s later: read once the location is answered
+    CHECK(modem.requestGsmLocation(onResponse));
+    unsigned long start = millis();
+    unsigned long maxCall = 0;
+    unsigned long dataTime = 0;
+    unsigned long locationTime = 0;
+    while (!dataTime && millis() - start < 12000) {
+        unsigned long t = millis();
+        if (t - start >= 1000 && fake.remote[0].empty()) {
+            fake.receive(0, "hello");
+        }
+        if (client.available()) {
+            dataTime = millis() - start;
+            uint8_t buf[8];
+            CHECK(client.read(buf, sizeof(buf)) == 5);
+        }
+        if (callbacks && !locationTime) {
+            locationTime = millis() - start;
+        }
+        if (millis() - t > maxCall)
+            maxCall = millis() - t;
+        delay(10);
+    }
+    printf("location after %lu ms, data read after %lu ms, available() took at most %lu ms\n",
+           locationTime, dataTime, maxCall);
+    CHECK(maxCall < 100);
+    CHECK(locationTime >= 8000 && locationTime < 8200);
+    CHECK(dataTime >= locationTime && dataTime < 8500);
+    CHECK(fake.overlapped == 0);
+    CHECK(callbacks == 1);
+    CHECK(callbackOk);
+    CHECK(callbackResponse.startsWith("0,2.294500,48.858400"));
+    CHECK(modem.queuedCommands() == 0);
+
+    // Location answered with an error: the command completes, a write is sent at once
+    fake.hook = [&fake](const std::string& cmd) {
+        if (cmd.compare(0, 11, "+CIPGSMLOC=") != 0)
+            return false;
+        fake.emit("\r\nERROR\r\n", 50);
+        return true;
+    };
+    callbacks = 0;
+    CHECK(modem.requestGsmLocation(onResponse));
+    modem.maintain();
+    start = millis();
+    CHECK(client.write((const uint8_t*) "ping", 4) == 4);
+    unsigned long writeTime = millis() - start;
+    for (int i = 0; i < 10 && !callbacks; i++) {
+        modem.maintain();
+        delay(10);
+    }
+    printf("write after the error took %lu ms, callback after %lu ms\n", writeTime, millis() - start);
+    CHECK(writeTime < 200);
+    CHECK(fake.sent[0] == "ping");
+    CHECK(callbacks == 1);
+    CHECK(!callbackOk);
+    CHECK(millis() - start < 500);
+    CHECK(fake.overlapped == 0);
+    fake.hook = NULL;
+
+    // Priority order, whatever the queuing order
+    fake.clearCounters();
+    CHECK(modem.queueCommand(GSM_PRIO_MANAGEMENT, "+CSQ", NULL, NULL));
+    CHECK(modem.queueCommand(GSM_PRIO_CONTROL, "+CIPQSEND=1", NULL, NULL));
+    for (int i = 0; i < 20; i++) {
+        modem.maintain();
+        delay(10);
+    }
+    CHECK(fake.log.size() >= 2);
+    CHECK(fake.log.size() >= 2 && fake.log[0] == "+CIPQSEND=1" && fake.log[1] == "+CSQ");
+
+    return failures ? 1 : 0;
+}
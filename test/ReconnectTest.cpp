@@ -0,0 +1,78 @@
+/*
+ * Copyright (C) 2018 Orange
+ *
+ * This software is distributed under the terms and conditions of the GNU Lesser
+ * General Public License (LGPL-3.0) which can be found in the file 'LICENSE.txt'
+ * in this package distribution.
+ */
+
+/*
+ * Automatic reconnection: GPRS is attached again with the APN and credentials given to
+ * attachGPRS(), and devices with different IMEIs draw different backoff delays.
+ */
+
+#define GSM_ENABLE_RECONNECT 1
+
+#include "TestModem.h"
+
+static int restored = 0;
+
+static void onReconnect(uint8_t, uint16_t)
+{
+    restored++;
+}
+
+// Time (ms) from the loss of the connection to the first reconnection attempt
+static unsigned long firstAttempt(const char* imei, bool& reattached)
+{
+    TestModem t;
+    FakeModem& fake = t.fake;
+    HeraclesGsmModem& modem = t.modem;
+    HeraclesGsmModem::GsmClient& client = t.client;
+    fake.imei = imei;
+
+    modem.init();
+    modem.attachGPRS("my.apn", "user", "secret");
+    client.setAutoReconnect(true, true, onReconnect);
+    CHECK(client.connect("1.2.3.4", 80));
+
+    // The bearer drops
+    fake.attached = false;
+    fake.close(0);
+    fake.clearCounters();
+    unsigned long lost = millis();
+    unsigned long attempt = 0;
+    while (millis() - lost < 5000) {
+        modem.maintain();
+        for (size_t i = 0; !attempt && i < fake.log.size(); i++) {
+            if (fake.log[i].compare(0, 10, "+CIPSTART=") == 0) {
+                attempt = millis() - lost;
+            }
+        }
+        delay(10);
+    }
+    reattached = false;
+    for (size_t i = 0; i < fake.log.size(); i++) {
+        if (fake.log[i] == "+CSTT=\"my.apn\",\"user\",\"secret\"") {
+            reattached = true;
+        }
+    }
+    CHECK(client.connected());
+    return attempt;
+}
+
+int main(void)
+{
+    bool reattached1, reattached2;
+    unsigned long t1 = firstAttempt("860000000000001", reattached1);
+    unsigned long t2 = firstAttempt("860000000000002", reattached2);
+    printf("first attempt after %lu ms and %lu ms\n", t1, t2);
+
+    CHECK(reattached1 && reattached2);
+    CHECK(restored == 2);
+    CHECK(t1 >= GSM_RECONNECT_MIN_DELAY / 2 && t1 <= GSM_RECONNECT_MIN_DELAY + 500);
+    CHECK(t2 >= GSM_RECONNECT_MIN_DELAY / 2 && t2 <= GSM_RECONNECT_MIN_DELAY + 500);
+    CHECK(t1 != t2);
+
+    return failures ? 1 : 0;
+}
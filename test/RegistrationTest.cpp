@@ -0,0 +1,39 @@
+/*
+ * Copyright (C) 2018 Orange
+ *
+ * This software is distributed under the terms and conditions of the GNU Lesser
+ * General Public License (LGPL-3.0) which can be found in the file 'LICENSE.txt'
+ * in this package distribution.
+ */
+
+/*
+ * Registration tracking: once known, the status follows the "+CREG:" URCs without queries,
+ * until factoryDefault() disables the URCs.
+ */
+
+#define GSM_ENABLE_REGISTRATION 1
+#include "TestModem.h"
+
+int main(void)
+{
+    TestModem t;
+    FakeModem& fake = t.fake;
+    HeraclesGsmModem& modem = t.modem;
+
+    modem.init();
+    CHECK(modem.getRegistrationStatus() == REG_OK_HOME);
+
+    fake.clearCounters();
+    fake.emit("\r\n+CREG: 5,\"1A2C\",\"00C4\"\r\n");
+    delay(10);
+    CHECK(modem.getRegistrationStatus() == REG_OK_ROAMING);
+    CHECK(modem.getCellId() == 0xC4);
+    CHECK(fake.commands == 0);
+
+    CHECK(modem.factoryDefault());
+    fake.clearCounters();
+    CHECK(modem.getRegistrationStatus() == REG_OK_HOME);
+    CHECK(fake.commands == 1);
+
+    return failures ? 1 : 0;
+}
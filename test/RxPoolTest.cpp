@@ -0,0 +1,73 @@
+/*
+ * Copyright (C) 2018 Orange
+ *
+ * This software is distributed under the terms and conditions of the GNU Lesser
+ * General Public License (LGPL-3.0) which can be found in the file 'LICENSE.txt'
+ * in this package distribution.
+ */
+
+/*
+ * Shared receive pool: a busy socket reading ahead keeps to its fair share of the pool,
+ * so a second socket still reads ahead its own data in one AT+CIPRXGET, and both streams
+ * are received intact.
+ */
+
+#define GSM_RX_POOL_BLOCKS 4
+#include "TestModem.h"
+
+static std::string pattern(char first, size_t len)
+{
+    std::string s;
+    for (size_t i = 0; i < len; i++)
+        s += (char) (first + i % 26);
+    return s;
+}
+
+// Read all the data of <client>, <chunk> bytes at a time
+static std::string readAll(HeraclesGsmModem::GsmClient& client, size_t chunk)
+{
+    std::string data;
+    uint8_t buf[64];
+    unsigned long start = millis();
+    while (millis() - start < 2000) {
+        int n = client.read(buf, chunk);
+        if (n > 0)
+            data.append((const char*) buf, n);
+        else
+            delay(10);
+    }
+    return data;
+}
+
+int main(void)
+{
+    TestModem t;
+    FakeModem& fake = t.fake;
+    HeraclesGsmModem::GsmClient& busy = t.client;
+    HeraclesGsmModem::GsmClient other(t.modem, 1, false);
+    CHECK(GSM_RX_POOL_SOCKET_BLOCKS == 2);
+    CHECK(t.connect());
+    CHECK(other.connect("1.2.3.4", 80));
+
+    std::string bulk = pattern('a', 1000);
+    std::string small = pattern('A', 100);
+    fake.receive(0, bulk);
+    fake.receive(1, small);
+    delay(100);
+
+    // The busy socket reads ahead its share only
+    uint8_t c;
+    CHECK(busy.read(&c, 1) == 1 && c == 'a');
+    CHECK(other.read(&c, 1) == 1 && c == 'A');
+
+    // The rest of the small stream was read ahead in the other half of the pool
+    fake.clearCounters();
+    std::string rest = readAll(other, 64);
+    CHECK(rest == small.substr(1));
+    CHECK(fake.count("+CIPRXGET=2,1,") == 0);
+
+    CHECK(readAll(busy, 64) == bulk.substr(1));
+    CHECK(fake.remote[0].empty() && fake.remote[1].empty());
+
+    return failures ? 1 : 0;
+}
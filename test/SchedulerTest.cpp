@@ -0,0 +1,73 @@
+/*
+ * Copyright (C) 2018 Orange
+ *
+ * This software is distributed under the terms and conditions of the GNU Lesser
+ * General Public License (LGPL-3.0) which can be found in the file 'LICENSE.txt'
+ * in this package distribution.
+ */
+
+/*
+ * GsmScheduler with 1, 4 and 16 modems, each with a connected socket receiving 2 KB:
+ * a step never takes more than one AT round trip, so the latency added to the other modems stays bounded.
+ * Prints, for each number of modems, the mean and longest step time, the longest client read
+ * (which makes its own round trips) and the total received throughput.
+ */
+
+#define GSM_ENABLE_QUEUE 1
+#define GSM_ENABLE_STATS 1
+#include "TestModem.h"
+#include <GsmScheduler.h>
+
+#define DATA_SIZE 2048
+
+template <unsigned N>
+static void sweep(void)
+{
+    TestModem t[N];
+    GsmScheduler<N> scheduler;
+
+    for (unsigned i = 0; i < N; i++) {
+        CHECK(t[i].connect());
+        CHECK(scheduler.add(t[i].modem));
+    }
+    for (unsigned i = 0; i < N; i++)
+        t[i].fake.receive(0, std::string(DATA_SIZE, 'x'));
+
+    size_t got = 0;
+    uint8_t data[256];
+    unsigned long start = millis();
+    unsigned long done = 0;
+    unsigned long maxRead = 0;
+    while (millis() - start < 30000 && !done) {
+        scheduler.runAll();
+        for (unsigned i = 0; i < N; i++) {
+            unsigned long readStart = micros();
+            got += t[i].client.read(data, sizeof(data));
+            if (micros() - readStart > maxRead)
+                maxRead = micros() - readStart;
+        }
+        if (got == N * DATA_SIZE)
+            done = millis() - start;
+        delay(1);
+    }
+
+    GsmSchedulerStats stats = scheduler.stats();
+    printf("%2u modems: %5lu steps, step mean %5lu us, longest %5lu us, read longest %6lu us, %5lu bytes/s\n", N,
+           (unsigned long) stats.steps, (unsigned long) (stats.totalStepTime / (stats.steps ? stats.steps : 1)),
+           (unsigned long) stats.maxStepTime, maxRead, (unsigned long) (got * 1000UL / (done ? done : 1)));
+    CHECK(done);
+    CHECK(got == N * DATA_SIZE);
+    CHECK(stats.maxStepTime < 50000);   // One round trip, never a timeout
+    for (unsigned i = 0; i < N; i++) {
+        CHECK(t[i].modem.getTrafficStats().timeouts == 0);
+        CHECK(t[i].client.connected());
+    }
+}
+
+int main(void)
+{
+    sweep<1>();
+    sweep<4>();
+    sweep<16>();
+    return failures ? 1 : 0;
+}
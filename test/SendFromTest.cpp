@@ -0,0 +1,67 @@
+/*
+ * Copyright (C) 2018 Orange
+ *
+ * This software is distributed under the terms and conditions of the GNU Lesser
+ * General Public License (LGPL-3.0) which can be found in the file 'LICENSE.txt'
+ * in this package distribution.
+ */
+
+/*
+ * GsmClient::sendFrom(): a complete upload, and a source that runs dry before <len>
+ * bytes, whose last transaction must be cancelled rather than completed with filler bytes.
+ */
+
+#include "TestModem.h"
+
+class MemoryStream : public Stream
+{
+public:
+    MemoryStream(const std::string& data) : _data(data), _pos(0) { setTimeout(10); }
+
+    virtual int available(void) { return _data.size() - _pos; }
+    virtual int peek(void) { return available() ? (uint8_t) _data[_pos] : -1; }
+    virtual int read(void) { return available() ? (uint8_t) _data[_pos++] : -1; }
+    virtual size_t write(uint8_t) { return 0; }
+
+private:
+    std::string _data;
+    size_t _pos;
+};
+
+int main(void)
+{
+    TestModem t;
+    FakeModem& fake = t.fake;
+    HeraclesGsmModem::GsmClient& client = t.client;
+    CHECK(t.connect());
+
+    std::string data;
+    for (int i = 0; i < 3000; i++)
+        data += (char) ('a' + i % 26);
+
+    MemoryStream full(data);
+    CHECK(client.sendFrom(full, data.size()) == data.size());
+    CHECK(fake.sent[0] == data);
+
+    // 100 bytes available for a 300 bytes upload: the single transaction is cancelled
+    fake.sent[0].clear();
+    MemoryStream dry(data.substr(0, 100));
+    size_t sent = client.sendFrom(dry, 300);
+    CHECK(sent == fake.sent[0].size());
+    CHECK(fake.sent[0].find('\0') == std::string::npos);
+    CHECK(fake.cancelled == 1);
+
+    // 1500 bytes available for a 3000 bytes upload: only the first transaction is sent
+    fake.sent[0].clear();
+    MemoryStream partial(data.substr(0, 1500));
+    sent = client.sendFrom(partial, 3000);
+    CHECK(sent == 1460);
+    CHECK(fake.sent[0] == data.substr(0, 1460));
+    CHECK(fake.cancelled == 2);
+
+    // The modem left data mode
+    CHECK(client.write((const uint8_t*) "end", 3) == 3);
+    CHECK(fake.sent[0] == data.substr(0, 1460) + "end");
+
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,170 @@
+/*
+ * Copyright (C) 2018 Orange
+ *
+ * This software is distributed under the terms and conditions of the GNU Lesser
+ * General Public License (LGPL-3.0) which can be found in the file 'LICENSE.txt'
+ * in this package distribution.
+ */
+
+/*
+ * Receive path cost of the serial type parameter: the same in-memory modem is used as a Stream
+ * (HeraclesGsmModem, virtual calls) and as a final class (BasicHeraclesGsmModem<FinalSerial>,
+ * whose calls the compiler may devirtualize), and the time per received byte of client reads
+ * is printed for both, in CPU cycles on x86. Informative only: nothing is checked but the data.
+ */
+
+#include <Arduino.h>
+#include <HeraclesGsmModem.h>
+#include <chrono>
+#include <string>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+static int failures = 0;
+#define CHECK(cond) do { if (!(cond)) { printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond); failures++; } } while (0)
+
+enum { TOTAL = 1 << 20, CHUNK = 1024, ROUNDS = 5 };
+
+/*
+ * Modem answering instantly from memory, without simulated wire time: connection 0 has <remaining> bytes
+ * to receive, returned by AT+CIPRXGET=2, and every other command is answered OK.
+ */
+class MemorySerial : public Stream
+{
+public:
+    MemorySerial() : remaining(0), _sent(0), _pos(0) {}
+
+    size_t remaining;
+
+    // <n> bytes arrive on connection 0, signalled by "+CIPRXGET: 1,0"
+    void receive(size_t n)
+    {
+        remaining = n;
+        _out += "\r\n+CIPRXGET: 1,0\r\n";
+    }
+
+    virtual int available(void) { return _out.size() - _pos; }
+    virtual int peek(void) { return _pos < _out.size() ? (uint8_t) _out[_pos] : -1; }
+
+    virtual int read(void)
+    {
+        if (_pos >= _out.size())
+            return -1;
+        int c = (uint8_t) _out[_pos++];
+        if (_pos == _out.size()) {
+            _out.clear();
+            _pos = 0;
+        }
+        return c;
+    }
+
+    using Print::write;
+
+    virtual size_t write(uint8_t c)
+    {
+        _line += (char) c;
+        if (_line.size() >= 2 && _line.compare(_line.size() - 2, 2, "\r\n") == 0) {
+            command(_line);
+            _line.clear();
+        }
+        return 1;
+    }
+
+private:
+    // Length reported as pending: at most one modem buffer
+    unsigned pending(void)
+    {
+        return remaining < 1460 ? remaining : 1460;
+    }
+
+    void command(const std::string& cmd)
+    {
+        char rsp[64];
+        unsigned n;
+        if (cmd.compare(0, 15, "AT+CIPRXGET=4,0") == 0) {
+            snprintf(rsp, sizeof(rsp), "\r\n+CIPRXGET: 4,0,%u\r\n\r\nOK\r\n", pending());
+            _out += rsp;
+        }
+        else if (sscanf(cmd.c_str(), "AT+CIPRXGET=2,0,%u", &n) == 1) {
+            if (n > remaining)
+                n = remaining;
+            remaining -= n;
+            snprintf(rsp, sizeof(rsp), "\r\n+CIPRXGET: 2,0,%u,%u\r\n", n, pending());
+            _out += rsp;
+            for (unsigned i = 0; i < n; i++)
+                _out += (char) ('a' + _sent++ % 26);
+            _out += "\r\nOK\r\n";
+        }
+        else if (cmd.compare(0, 12, "AT+CIPSTART=") == 0) {
+            _out += "\r\nOK\r\n\r\n0, CONNECT OK\r\n";
+        }
+        else {
+            _out += "\r\nOK\r\n";
+        }
+    }
+
+    size_t _sent;   // Data bytes returned, byte k being 'a' + k % 26
+    std::string _out;
+    size_t _pos;
+    std::string _line;
+};
+
+class FinalSerial final : public MemorySerial
+{
+};
+
+static uint64_t now(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+// Best time per byte over ROUNDS reads of TOTAL bytes from a <SerialT> modem, driven as a <ModemSerialT>
+template <class SerialT, class ModemSerialT>
+static double receive(const char* name)
+{
+    double best = 0;
+    for (int round = 0; round < ROUNDS; round++) {
+        SerialT serial;
+        BasicHeraclesGsmModem<ModemSerialT> modem(serial);
+        typename BasicHeraclesGsmModem<ModemSerialT>::GsmClient client(modem, 0, false);
+        CHECK(client.connect("1.2.3.4", 80));
+        serial.receive(TOTAL);
+
+        static uint8_t buf[CHUNK];
+        size_t total = 0;
+        bool intact = true;
+        uint64_t start = now();
+        while (total < TOTAL) {
+            int n = client.read(buf, CHUNK);
+            if (n <= 0)
+                break;
+            intact = intact && buf[0] == 'a' + total % 26 && buf[n - 1] == 'a' + (total + n - 1) % 26;
+            total += n;
+        }
+        double perByte = (double) (now() - start) / TOTAL;
+        CHECK(total == TOTAL);
+        CHECK(intact);
+        if (!round || perByte < best)
+            best = perByte;
+    }
+#if defined(__x86_64__) || defined(__i386__)
+    printf("%-12s %6.2f cycles per received byte\n", name, best);
+#else
+    printf("%-12s %6.2f ns per received byte\n", name, best);
+#endif
+    return best;
+}
+
+int main(void)
+{
+    double virt = receive<MemorySerial, Stream>("Stream");
+    double fin = receive<FinalSerial, FinalSerial>("FinalSerial");
+    printf("final / Stream: %.2f\n", fin / virt);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,66 @@
+/*
+ * Copyright (C) 2018 Orange
+ *
+ * This software is distributed under the terms and conditions of the GNU Lesser
+ * General Public License (LGPL-3.0) which can be found in the file 'LICENSE.txt'
+ * in this package distribution.
+ */
+
+/*
+ * RAM footprint of one feature configuration (built once per configuration, see CMakeLists.txt):
+ * prints sizeof() of the modem and of a GsmClient, and on 64-bit hosts checks them against
+ * the line of the budget file for the configuration. The configuration must also connect,
+ * send and receive against FakeModem.
+ */
+
+#include "TestModem.h"
+
+int main(int argc, char** argv)
+{
+    if (argc < 3) {
+        fprintf(stderr, "usage: %s <configuration> <budget file>\n", argv[0]);
+        return 2;
+    }
+    unsigned long modemSize = sizeof(HeraclesGsmModem);
+    unsigned long clientSize = sizeof(HeraclesGsmModem::GsmClient);
+    printf("%-10s modem %lu bytes, GsmClient %lu bytes\n", argv[1], modemSize, clientSize);
+
+    if (sizeof(void*) == 8) {
+        FILE* f = fopen(argv[2], "r");
+        if (!f) {
+            fprintf(stderr, "can't open %s\n", argv[2]);
+            return 2;
+        }
+        bool found = false;
+        char line[128];
+        while (fgets(line, sizeof(line), f)) {
+            char name[32];
+            unsigned long modem, client;
+            if (line[0] != '#' && sscanf(line, "%31s %lu %lu", name, &modem, &client) == 3
+                    && strcmp(name, argv[1]) == 0) {
+                found = true;
+                CHECK(modemSize <= modem);
+                CHECK(clientSize <= client);
+            }
+        }
+        fclose(f);
+        CHECK(found);
+    }
+
+    TestModem t;
+    CHECK(t.connect());
+    CHECK(t.modem.getRegistrationStatus() == REG_OK_HOME);
+    CHECK(t.modem.getIMEI() == "860000000000001");
+    CHECK(t.client.write((const uint8_t*) "ping", 4) == 4);
+    CHECK(t.fake.sent[0] == "ping");
+    t.fake.receive(0, "pong");
+    char data[8] = { 0 };
+    for (unsigned long start = millis(); !t.client.available() && millis() - start < 10000;) {
+        t.modem.maintain();
+        delay(10);
+    }
+    CHECK(t.client.read((uint8_t*) data, sizeof(data) - 1) == 4);
+    CHECK(strcmp(data, "pong") == 0);
+
+    return failures ? 1 : 0;
+}
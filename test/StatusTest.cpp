@@ -0,0 +1,56 @@
+/*
+ * Copyright (C) 2018 Orange
+ *
+ * This software is distributed under the terms and conditions of the GNU Lesser
+ * General Public License (LGPL-3.0) which can be found in the file 'LICENSE.txt'
+ * in this package distribution.
+ */
+
+/*
+ * Connection status refresh of maintain(): with two idle connections, each tick costs
+ * at most one AT+CIPRXGET=4 per connection and a single AT+CIPSTATUS, answered without
+ * timeout, and a connection closed silently by the peer is noticed.
+ */
+
+#define GSM_ENABLE_QUEUE 1
+#define GSM_ENABLE_STATS 1
+#include "TestModem.h"
+
+int main(void)
+{
+    TestModem t;
+    FakeModem& fake = t.fake;
+    HeraclesGsmModem& modem = t.modem;
+    HeraclesGsmModem::GsmClient& client0 = t.client;
+    HeraclesGsmModem::GsmClient client1(modem, 1, false);
+    CHECK(t.connect());
+    CHECK(client1.connect("1.2.3.4", 80));
+
+    fake.close(1, false); // No "1, CLOSED" URC
+    modem.clearTrafficStats();
+
+    unsigned ticks = 0;
+    unsigned maxCommands = 0;
+    unsigned long maxTime = 0;
+    for (unsigned long start = millis(); millis() - start < 10000; delay(10)) {
+        fake.clearCounters();
+        unsigned long t = millis();
+        modem.maintain();
+        if (fake.commands) {
+            ticks++;
+            if (fake.commands > maxCommands)
+                maxCommands = fake.commands;
+            if (millis() - t > maxTime)
+                maxTime = millis() - t;
+        }
+    }
+    printf("%u ticks with commands, at most %u round trips and %lu ms per tick\n", ticks, maxCommands, maxTime);
+
+    CHECK(maxCommands <= 3);
+    CHECK(maxTime < 100);
+    CHECK(modem.getTrafficStats().timeouts == 0);
+    CHECK(client0.connected());
+    CHECK(!client1.connected());
+
+    return failures ? 1 : 0;
+}
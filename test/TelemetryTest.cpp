@@ -0,0 +1,50 @@
+/*
+ * Copyright (C) 2018 Orange
+ *
+ * This software is distributed under the terms and conditions of the GNU Lesser
+ * General Public License (LGPL-3.0) which can be found in the file 'LICENSE.txt'
+ * in this package distribution.
+ */
+
+/*
+ * Telemetry snapshot: one AT+CSQ;+CREG?;+COPS?;+CBC round trip, parsed into GsmTelemetry.
+ */
+
+#define GSM_ENABLE_REGISTRATION 1
+#include "TestModem.h"
+
+int main(void)
+{
+    TestModem tm;
+    FakeModem& fake = tm.fake;
+    HeraclesGsmModem& modem = tm.modem;
+
+    fake.hook = [&fake](const std::string& cmd) {
+        if (cmd == "+CSQ;+CREG?;+COPS?;+CBC") {
+            fake.emit("\r\n+CSQ: 17,0\r\n"
+                      "\r\n+CREG: 2,5,\"1A2B\",\"00C3\"\r\n"
+                      "\r\n+COPS: 0,0,\"Orange F\"\r\n"
+                      "\r\n+CBC: 0,87,4012\r\n"
+                      "\r\nOK\r\n", fake.latency);
+            return true;
+        }
+        return false;
+    };
+
+    modem.init();
+    fake.clearCounters();
+    GsmTelemetry t;
+    CHECK(modem.getTelemetry(t));
+    CHECK(fake.commands == 1);
+    CHECK(t.signalQuality == 17);
+    CHECK(t.bitErrorRate == 0);
+    CHECK(t.registration == REG_OK_ROAMING);
+    CHECK(t.locationAreaCode == 0x1A2B);
+    CHECK(t.cellId == 0xC3);
+    CHECK(strcmp(t.operatorName, "Orange F") == 0);
+    CHECK(t.battPercent == 87);
+    CHECK(t.battVoltage == 4012);
+    CHECK(modem.getCellId() == 0xC3);
+
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,45 @@
+/*
+ * Copyright (C) 2018 Orange
+ *
+ * This software is distributed under the terms and conditions of the GNU Lesser
+ * General Public License (LGPL-3.0) which can be found in the file 'LICENSE.txt'
+ * in this package distribution.
+ */
+
+#ifndef __TestModem_h
+#define __TestModem_h
+
+/*
+ * Common part of the tests: CHECK() counts the failed conditions of the test in <failures>,
+ * and TestModem is the library modem on a FakeModem, with one client (mux 0, without SSL).
+ * Feature macros (GSM_ENABLE_*) must be defined before including this file.
+ */
+
+#include "FakeModem.h"
+#include <HeraclesGsmModem.h>
+
+static int failures = 0;
+
+#define CHECK(cond) do { if (!(cond)) { printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond); failures++; } } while (0)
+
+struct TestModem {
+    FakeModem fake;
+    HeraclesGsmModem modem;
+    HeraclesGsmModem::GsmClient client;
+
+    TestModem() : modem(fake), client(modem, 0, false) {}
+
+    // init() and attachGPRS()
+    bool attach(void)
+    {
+        return modem.init() && modem.attachGPRS("apn", "", "");
+    }
+
+    // attach(), and connect the client to 1.2.3.4:80
+    bool connect(void)
+    {
+        return attach() && client.connect("1.2.3.4", 80);
+    }
+};
+
+#endif
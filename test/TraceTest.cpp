@@ -0,0 +1,40 @@
+/*
+ * Copyright (C) 2018 Orange
+ *
+ * This software is distributed under the terms and conditions of the GNU Lesser
+ * General Public License (LGPL-3.0) which can be found in the file 'LICENSE.txt'
+ * in this package distribution.
+ */
+
+/*
+ * Wire tracing: the command events of a connection identify the commands sent.
+ */
+
+#define GSM_ENABLE_TRACE 1
+
+#include "TestModem.h"
+
+int main(void)
+{
+    TestModem t;
+    HeraclesGsmModem& modem = t.modem;
+    CHECK(t.attach());
+
+    GsmTraceEvent trace[16];
+    modem.setTraceBuffer(trace, 16);
+    CHECK(t.client.connect("1.2.3.4", 80));
+
+    uint16_t commands[4];
+    unsigned count = 0;
+    for (uint32_t i = 0; i < modem.getTraceCount() && i < 16; i++) {
+        if (trace[i].type == GSM_TRACE_COMMAND && count < 4) {
+            commands[count++] = trace[i].value;
+        }
+    }
+    CHECK(count == 2);
+    CHECK(count == 2 && commands[0] == HeraclesGsmModem::commandId("+CIPSSL="));
+    CHECK(count == 2 && commands[1] == HeraclesGsmModem::commandId("+CIPSTART="));
+    CHECK(HeraclesGsmModem::commandId("+CIPSEND=") != HeraclesGsmModem::commandId("+CIPSEND?"));
+
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,51 @@
+/*
+ * Copyright (C) 2018 Orange
+ *
+ * This software is distributed under the terms and conditions of the GNU Lesser
+ * General Public License (LGPL-3.0) which can be found in the file 'LICENSE.txt'
+ * in this package distribution.
+ */
+
+/*
+ * USSD answers decoded to UTF-8: GSM 7 bit default alphabet (basic table and escape to the extension
+ * table, '@' being 0x00), UCS2, and truncation to the caller buffer without splitting a character.
+ */
+
+#include "TestModem.h"
+
+int main(void)
+{
+    TestModem t;
+    FakeModem& fake = t.fake;
+    std::string answer;
+    std::string dcs = "15";
+    fake.hook = [&fake, &answer, &dcs](const std::string& cmd) {
+        if (cmd.compare(0, 6, "+CUSD=") != 0)
+            return false;
+        fake.emit("\r\nOK\r\n", fake.latency);
+        fake.emit("\r\n+CUSD: 0,\"" + answer + "\"," + dcs + "\r\n", 100);
+        return true;
+    };
+    CHECK(t.modem.init());
+
+    // "@ $£ {€} Ωé\n": '@' 0x00, '$' 0x02, '£' 0x01, escapes 0x1B 0x28/0x65/0x29, 'Ω' 0x15, 'é' 0x05
+    answer = "0020020120" "1B28" "1B65" "1B29" "20" "1505" "0A";
+    String s = t.modem.sendUSSD("*100#");
+    CHECK(s == "@ $\xC2\xA3 {\xE2\x82\xAC} \xCE\xA9\xC3\xA9\n");
+
+    // UCS2 (data coding scheme 72): "Ω€"
+    answer = "03A920AC";
+    dcs = "72";
+    s = t.modem.sendUSSD("*100#");
+    CHECK(s == "\xCE\xA9\xE2\x82\xAC");
+
+    // 7 bit answer larger than the buffer: whole characters only
+    answer = "1B651B651B651B651B651B65";
+    dcs = "15";
+    char buf[16];
+    int len = t.modem.sendUSSD("*100#", buf, sizeof(buf));
+    CHECK(len == 9);
+    CHECK(strcmp(buf, "\xE2\x82\xAC\xE2\x82\xAC\xE2\x82\xAC") == 0);
+
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,261 @@
+/*
+ * Copyright (C) 2018 Orange
+ *
+ * This software is distributed under the terms and conditions of the GNU Lesser
+ * General Public License (LGPL-3.0) which can be found in the file 'LICENSE.txt'
+ * in this package distribution.
+ */
+
+/*
+ * Minimal host implementation of the Arduino core API used by the library.
+ * Time is simulated: millis() and micros() only advance when the library waits
+ * (delay(), yield, serial reads and writes), so that long timeouts run instantly.
+ */
+
+#ifndef __Arduino_h
+#define __Arduino_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+
+#define DEC 10
+#define HEX 16
+
+#define LOW 0
+#define HIGH 1
+#define INPUT 0
+#define OUTPUT 1
+
+#define constrain(x, a, b) ((x) < (a) ? (a) : ((x) > (b) ? (b) : (x)))
+
+// Simulated time (us)
+inline uint64_t& mockClock(void)
+{
+    static uint64_t now = 0;
+    return now;
+}
+
+inline void mockAdvance(uint64_t us)
+{
+    mockClock() += us;
+}
+
+inline unsigned long millis(void)
+{
+    return (unsigned long) (mockClock() / 1000);
+}
+
+inline unsigned long micros(void)
+{
+    return (unsigned long) mockClock();
+}
+
+// delay(0) is the library yield point: it lets 100 us of simulated time pass
+inline void delay(unsigned long ms)
+{
+    mockAdvance(ms ? ms * 1000ULL : 100);
+}
+
+inline void yield(void)
+{
+    delay(0);
+}
+
+inline void randomSeed(unsigned long seed)
+{
+    srand((unsigned) seed);
+}
+
+inline long random(long max)
+{
+    return max > 0 ? rand() % max : 0;
+}
+
+inline long random(long min, long max)
+{
+    return min + random(max - min);
+}
+
+inline void pinMode(uint8_t, uint8_t) {}
+inline void digitalWrite(uint8_t, uint8_t) {}
+
+class String
+{
+public:
+    String() {}
+    String(const char* s) { if (s) _s = s; }
+    String(const std::string& s) : _s(s) {}
+    String(char c) : _s(1, c) {}
+    String(int v) : _s(std::to_string(v)) {}
+    String(unsigned v) : _s(std::to_string(v)) {}
+    String(long v) : _s(std::to_string(v)) {}
+    String(unsigned long v) : _s(std::to_string(v)) {}
+
+    void reserve(size_t n) { _s.reserve(n); }
+    unsigned length(void) const { return _s.size(); }
+    const char* c_str(void) const { return _s.c_str(); }
+
+    String& operator+=(const String& s) { _s += s._s; return *this; }
+    String& operator+=(const char* s) { _s += s; return *this; }
+    String& operator+=(char c) { _s += c; return *this; }
+    String& operator+=(unsigned char v) { _s += std::to_string(v); return *this; }
+    String& operator+=(int v) { _s += std::to_string(v); return *this; }
+    String& operator+=(unsigned v) { _s += std::to_string(v); return *this; }
+    String& operator+=(long v) { _s += std::to_string(v); return *this; }
+    String& operator+=(unsigned long v) { _s += std::to_string(v); return *this; }
+    friend String operator+(const String& a, const String& b) { return String(a._s + b._s); }
+
+    char operator[](unsigned i) const { return i < _s.size() ? _s[i] : 0; }
+    bool operator==(const String& s) const { return _s == s._s; }
+    bool operator==(const char* s) const { return _s == s; }
+    bool operator!=(const char* s) const { return _s != s; }
+
+    bool startsWith(const String& s) const { return _s.compare(0, s._s.size(), s._s) == 0; }
+    bool endsWith(const String& s) const
+    {
+        return _s.size() >= s._s.size() && _s.compare(_s.size() - s._s.size(), s._s.size(), s._s) == 0;
+    }
+    int indexOf(char c, unsigned from = 0) const { return pos(_s.find(c, from)); }
+    int indexOf(const String& s, unsigned from = 0) const { return pos(_s.find(s._s, from)); }
+    int lastIndexOf(char c) const { return pos(_s.rfind(c)); }
+    int lastIndexOf(const char* s, unsigned from) const { return pos(_s.rfind(s, from)); }
+    String substring(unsigned from) const { return from < _s.size() ? String(_s.substr(from)) : String(); }
+    String substring(unsigned from, unsigned to) const
+    {
+        if (to > _s.size()) to = _s.size();
+        if (from > to) from = to;
+        return String(_s.substr(from, to - from));
+    }
+    void replace(const String& a, const String& b)
+    {
+        for (size_t p = 0; a._s.size() && (p = _s.find(a._s, p)) != std::string::npos; p += b._s.size())
+            _s.replace(p, a._s.size(), b._s);
+    }
+    void trim(void)
+    {
+        size_t a = _s.find_first_not_of(" \t\r\n");
+        size_t b = _s.find_last_not_of(" \t\r\n");
+        _s = (a == std::string::npos) ? std::string() : _s.substr(a, b - a + 1);
+    }
+    long toInt(void) const { return atol(_s.c_str()); }
+
+private:
+    static int pos(size_t p) { return p == std::string::npos ? -1 : (int) p; }
+
+    std::string _s;
+};
+
+class Print
+{
+public:
+    virtual ~Print() {}
+    virtual size_t write(uint8_t c) = 0;
+    virtual size_t write(const uint8_t* buf, size_t size)
+    {
+        size_t n = 0;
+        while (size--)
+            n += write(*buf++);
+        return n;
+    }
+    size_t write(const char* s) { return write((const uint8_t*) s, strlen(s)); }
+    size_t write(const char* s, size_t size) { return write((const uint8_t*) s, size); }
+    virtual void flush(void) {}
+
+    size_t print(const char* s) { return write(s); }
+    size_t print(const String& s) { return write(s.c_str()); }
+    size_t print(char c) { return write((uint8_t) c); }
+    size_t print(unsigned char v, int base = DEC) { return printNumber(v, base); }
+    size_t print(int v, int base = DEC) { return print((long) v, base); }
+    size_t print(unsigned v, int base = DEC) { return printNumber(v, base); }
+    size_t print(long v, int base = DEC)
+    {
+        if (v < 0 && base == DEC)
+            return write('-') + printNumber(-v, base);
+        return printNumber(v, base);
+    }
+    size_t print(unsigned long v, int base = DEC) { return printNumber(v, base); }
+    size_t print(double v, int = 2) { return print(String(std::to_string(v))); }
+    size_t println(void) { return write("\r\n"); }
+    template <class T> size_t println(T v) { return print(v) + println(); }
+
+private:
+    size_t printNumber(unsigned long v, int base)
+    {
+        char buf[34];
+        char* p = buf + sizeof(buf) - 1;
+        *p = 0;
+        do {
+            int d = v % base;
+            *--p = d < 10 ? '0' + d : 'A' + d - 10;
+            v /= base;
+        } while (v);
+        return write(p);
+    }
+};
+
+class Stream : public Print
+{
+public:
+    Stream() : _timeout(1000) {}
+
+    virtual int available(void) = 0;
+    virtual int read(void) = 0;
+    virtual int peek(void) = 0;
+
+    void setTimeout(unsigned long timeout) { _timeout = timeout; }
+
+    size_t readBytes(uint8_t* buf, size_t size)
+    {
+        size_t n = 0;
+        for (int c; n < size && (c = timedRead()) >= 0;)
+            buf[n++] = c;
+        return n;
+    }
+    size_t readBytes(char* buf, size_t size) { return readBytes((uint8_t*) buf, size); }
+    size_t readBytesUntil(char terminator, char* buf, size_t size)
+    {
+        size_t n = 0;
+        for (int c; n < size && (c = timedRead()) >= 0 && c != terminator;)
+            buf[n++] = c;
+        return n;
+    }
+    String readStringUntil(char terminator)
+    {
+        String s;
+        for (int c; (c = timedRead()) >= 0 && c != terminator;)
+            s += (char) c;
+        return s;
+    }
+
+protected:
+    int timedRead(void)
+    {
+        unsigned long start = millis();
+        do {
+            int c = read();
+            if (c >= 0)
+                return c;
+            yield();
+        } while (millis() - start < _timeout);
+        return -1;
+    }
+
+    unsigned long _timeout;
+};
+
+class IPAddress
+{
+public:
+    IPAddress() { memset(_a, 0, sizeof(_a)); }
+    IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d) { _a[0] = a; _a[1] = b; _a[2] = c; _a[3] = d; }
+    uint8_t operator[](int i) const { return _a[i]; }
+    uint8_t& operator[](int i) { return _a[i]; }
+
+private:
+    uint8_t _a[4];
+};
+
+#endif